@@ -0,0 +1,401 @@
+/* sdwm benchmark driver: starts sdwm on $DISPLAY, creates dummy clients
+ * and drives it with XTest, reporting per scenario wall time, requests and
+ * round trips sdwm issued, and its peak RSS. See bench/run.sh. */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/keysym.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+#ifdef RANDR
+#include <X11/Xlib-xcb.h>
+#include <xcb/randr.h>
+#endif /* RANDR */
+
+#include "../util.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define MODKEY                  XK_Alt_L /* Mod1Mask in config.h */
+#define CONNECTIONS             32 /* clients come from this many X clients */
+
+struct stats
+{
+	unsigned long requests;
+	unsigned long roundtrips;
+	unsigned long passes;
+	unsigned long layout_us; /* time spent in layout passes */
+};
+
+struct scenario
+{
+	const char * name;
+	void (* drive) (int n);
+};
+
+static void createclients(int n);
+static void destroyclients(int n);
+static void focusstack(int n);
+static void key(KeySym modifier, KeySym sym);
+static void lookup(int n);
+static void mapstorm(int n);
+#ifdef RANDR
+static void outputs(int n);
+#endif /* RANDR */
+static long peakrss(void);
+static void readstats(struct stats *s);
+static void run(const char *wm, int n);
+static void setmfact(int n);
+static void startwm(const char *path);
+static void stopwm(void);
+static void tag(int n);
+static void tagmon(int n);
+static void view(int n);
+static void zoom(int n);
+
+static Display * display;
+static Display * connections[CONNECTIONS]; /* window i belongs to i % CONNECTIONS */
+static pid_t wm_pid;
+static FILE * wm_stderr;
+static Window * windows;
+
+static const struct scenario scenarios[] = {
+	{ "map",        createclients },
+	{ "view",       view },
+	{ "tag",        tag },
+	{ "setmfact",   setmfact },
+	{ "zoom",       zoom },
+	{ "focusstack", focusstack },
+	{ "lookup",     lookup },
+	{ "tagmon",     tagmon },
+#ifdef RANDR
+	{ "outputs",    outputs },
+#endif /* RANDR */
+	{ "mapstorm",   mapstorm },
+	{ "destroy",    destroyclients },
+};
+
+void createclients(int n)
+{
+	int i;
+	Display *d;
+	windows = ecalloc(n, sizeof(Window));
+	/* each connection has its own id base, as separate applications do */
+	for (i = 0; i < n; i++) {
+		d = connections[i % CONNECTIONS];
+		windows[i] = XCreateSimpleWindow(d, DefaultRootWindow(d), 0, 0, 200, 200, 0, 0, 0);
+		XMapWindow(d, windows[i]);
+	}
+}
+
+void destroyclients(int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		XDestroyWindow(connections[i % CONNECTIONS], windows[i]);
+	free(windows);
+	windows = NULL;
+}
+
+void focusstack(int n)
+{
+	int i;
+	for (i = 0; i < 25; i++) {
+		key(MODKEY, XK_j);
+		key(MODKEY, XK_k);
+	}
+}
+
+/* the pointer jumps across the screen, sdwm looks up the window of every
+ * crossing; the same number of jumps whatever n, so the time stays flat if
+ * lookups do */
+void lookup(int n)
+{
+	int i, w = DisplayWidth(display, DefaultScreen(display));
+	int h = DisplayHeight(display, DefaultScreen(display));
+	for (i = 0; i < 500; i++)
+		XTestFakeMotionEvent(display, -1, i * 7919 % w, i * 104729 % h, CurrentTime);
+}
+
+/* one press and release of sym with modifier held, NoSymbol for none */
+void key(KeySym modifier, KeySym sym)
+{
+	KeyCode m = modifier != NoSymbol ? XKeysymToKeycode(display, modifier) : 0;
+	KeyCode k = XKeysymToKeycode(display, sym);
+	if (m)
+		XTestFakeKeyEvent(display, m, True, CurrentTime);
+	XTestFakeKeyEvent(display, k, True, CurrentTime);
+	XTestFakeKeyEvent(display, k, False, CurrentTime);
+	if (m)
+		XTestFakeKeyEvent(display, m, False, CurrentTime);
+}
+
+void mapstorm(int n)
+{
+	int i, j;
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < n; i++)
+			XUnmapWindow(connections[i % CONNECTIONS], windows[i]);
+		for (i = 0; i < n; i++)
+			XMapWindow(connections[i % CONNECTIONS], windows[i]);
+	}
+}
+
+#ifdef RANDR
+/* switches the mode of the first active CRTC between its own and a smaller
+ * one, and waits after each switch until sdwm has laid the monitor out
+ * again: RandR notify, GEOMSETTLE, updateoutputs() and the relayout. Xvfb
+ * has a single CRTC, so the monitor is resized but never removed; servers
+ * with more CRTCs would need one turned off for removemon(). Skipped where
+ * the server has no RandR, as Xvfb with Xinerama */
+void outputs(int n)
+{
+	int i, j;
+	struct stats s;
+	unsigned long passes;
+	xcb_connection_t *xcb = XGetXCBConnection(display);
+	xcb_window_t root = DefaultRootWindow(display);
+	const xcb_query_extension_reply_t *ext;
+	xcb_randr_get_screen_resources_current_reply_t *res;
+	xcb_randr_get_crtc_info_reply_t *crtc = NULL;
+	xcb_randr_create_mode_reply_t *created;
+	xcb_randr_set_crtc_config_reply_t *set;
+	xcb_randr_crtc_t *crtcs, id = 0;
+	xcb_randr_output_t *out;
+	xcb_randr_mode_info_t info = { 0 };
+	xcb_randr_mode_t modes[2];
+	char name[] = "sdwm-bench";
+
+	ext = xcb_get_extension_data(xcb, &xcb_randr_id);
+	if (!ext || !ext->present || !(res = xcb_randr_get_screen_resources_current_reply(xcb,
+		xcb_randr_get_screen_resources_current(xcb, root), NULL)))
+		return;
+	crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+	for (i = 0; i < xcb_randr_get_screen_resources_current_crtcs_length(res); i++) {
+		crtc = xcb_randr_get_crtc_info_reply(xcb,
+			xcb_randr_get_crtc_info(xcb, crtcs[i], res->config_timestamp), NULL);
+		if (crtc && crtc->mode && crtc->num_outputs) {
+			id = crtcs[i];
+			break;
+		}
+		free(crtc);
+		crtc = NULL;
+	}
+	free(res);
+	if (!crtc)
+		return;
+	out = xcb_randr_get_crtc_info_outputs(crtc);
+	info.width = crtc->width * 2 / 3;
+	info.height = crtc->height * 2 / 3;
+	info.hsync_start = info.hsync_end = info.htotal = info.width;
+	info.vsync_start = info.vsync_end = info.vtotal = info.height;
+	info.dot_clock = 60 * info.htotal * info.vtotal;
+	info.name_len = sizeof name - 1;
+	if (!(created = xcb_randr_create_mode_reply(xcb,
+		xcb_randr_create_mode(xcb, root, info, info.name_len, name), NULL))) {
+		free(crtc);
+		return;
+	}
+	modes[0] = created->mode;
+	modes[1] = crtc->mode;
+	free(created);
+	xcb_randr_add_output_mode(xcb, out[0], modes[0]);
+	for (i = 0; i < 10; i++) {
+		readstats(&s);
+		passes = s.passes;
+		set = xcb_randr_set_crtc_config_reply(xcb, xcb_randr_set_crtc_config(xcb, id,
+			XCB_CURRENT_TIME, XCB_CURRENT_TIME, crtc->x, crtc->y, modes[i % 2],
+			crtc->rotation, crtc->num_outputs, out), NULL);
+		if (!set || set->status != XCB_RANDR_SET_CONFIG_SUCCESS)
+			die("bench: cannot set the CRTC mode");
+		free(set);
+		for (j = 0; j < 1000 && s.passes == passes; j++) {
+			usleep(1000);
+			readstats(&s);
+		}
+	}
+	xcb_randr_delete_output_mode(xcb, out[0], modes[0]);
+	xcb_randr_destroy_mode(xcb, modes[0]);
+	xcb_flush(xcb);
+	free(crtc);
+}
+#endif /* RANDR */
+
+/* peak resident set of sdwm in kB, -1 if unknown */
+long peakrss(void)
+{
+	char path[64], line[256];
+	long kb = -1;
+	FILE *f;
+	snprintf(path, sizeof path, "/proc/%d/status", (int)wm_pid);
+	if (!(f = fopen(path, "r")))
+		return -1;
+	while (fgets(line, sizeof line, f))
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+/* sdwm dumps its counters once it has handled all pending input */
+void readstats(struct stats *s)
+{
+	char line[256];
+	int i;
+	for (i = 0; i < CONNECTIONS; i++)
+		XSync(connections[i], False);
+	XSync(display, False);
+	kill(wm_pid, SIGUSR1);
+	while (fgets(line, sizeof line, wm_stderr))
+		if (sscanf(line, "sdwm: requests %lu roundtrips %lu",
+			&s->requests, &s->roundtrips) == 2)
+			break;
+	while (fgets(line, sizeof line, wm_stderr))
+		if (sscanf(line, "sdwm: layout passes %lu total %luus",
+			&s->passes, &s->layout_us) == 2)
+			return;
+	die("bench: sdwm exited");
+}
+
+void run(const char *wm, int n)
+{
+	unsigned int i;
+	struct stats before, after;
+	struct timespec t0, t1;
+	startwm(wm);
+	for (i = 0; i < LENGTH(scenarios); i++) {
+		readstats(&before);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		scenarios[i].drive(n);
+		readstats(&after);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		printf("%-12s %6d %10.2f %10lu %10lu %10.2f %8ld\n", scenarios[i].name, n,
+			(t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+			after.requests - before.requests,
+			after.roundtrips - before.roundtrips,
+			(after.layout_us - before.layout_us) / 1e3, peakrss());
+		fflush(stdout);
+	}
+	stopwm();
+}
+
+void setmfact(int n)
+{
+	int i;
+	for (i = 0; i < 10; i++) {
+		key(MODKEY, XK_l);
+		key(MODKEY, XK_h);
+	}
+}
+
+void startwm(const char *path)
+{
+	int fds[2], i;
+	XWindowAttributes wa;
+	if (pipe(fds) == -1)
+		die("pipe:");
+	if ((wm_pid = fork()) == -1)
+		die("fork:");
+	if (!wm_pid) {
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(path, path, (char *)NULL);
+		die("bench: execl %s:", path);
+	}
+	close(fds[1]);
+	if (!(wm_stderr = fdopen(fds[0], "r")))
+		die("fdopen:");
+	/* sdwm is up once it holds the substructure redirect on root */
+	for (i = 0; i < 500; i++) {
+		XGetWindowAttributes(display, DefaultRootWindow(display), &wa);
+		if (wa.all_event_masks & SubstructureRedirectMask)
+			return;
+		usleep(10000);
+	}
+	die("bench: sdwm did not start");
+}
+
+void stopwm(void)
+{
+	kill(wm_pid, SIGTERM);
+	waitpid(wm_pid, NULL, 0);
+	fclose(wm_stderr);
+}
+
+void tag(int n)
+{
+	int i;
+	KeyCode shift = XKeysymToKeycode(display, XK_Shift_L);
+	for (i = 0; i < 10; i++) {
+		XTestFakeKeyEvent(display, shift, True, CurrentTime);
+		key(MODKEY, XK_2);
+		XTestFakeKeyEvent(display, shift, False, CurrentTime);
+		key(MODKEY, XK_2);
+		XTestFakeKeyEvent(display, shift, True, CurrentTime);
+		key(MODKEY, XK_1);
+		XTestFakeKeyEvent(display, shift, False, CurrentTime);
+		key(MODKEY, XK_1);
+	}
+}
+
+/* focusmon and tagmon between the monitors there are, the monitor setup
+ * itself does not change */
+void tagmon(int n)
+{
+	int i;
+	KeyCode shift = XKeysymToKeycode(display, XK_Shift_L);
+	for (i = 0; i < 10; i++) {
+		key(MODKEY, XK_period); /* focusmon */
+		XTestFakeKeyEvent(display, shift, True, CurrentTime);
+		key(MODKEY, XK_period); /* tagmon */
+		XTestFakeKeyEvent(display, shift, False, CurrentTime);
+	}
+}
+
+void view(int n)
+{
+	int i;
+	for (i = 0; i < 20; i++) {
+		key(MODKEY, XK_2);
+		key(MODKEY, XK_1);
+	}
+}
+
+void zoom(int n)
+{
+	int i;
+	for (i = 0; i < 20; i++) {
+		key(MODKEY, XK_Return);
+		key(MODKEY, XK_j);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i, n, ev, er, maj, min;
+	if (argc < 3)
+		die("usage: %s sdwm clients...", argv[0]);
+	for (i = 0; i < 100 && !(display = XOpenDisplay(NULL)); i++)
+		usleep(50000);
+	if (!display)
+		die("bench: cannot open display");
+	if (!XTestQueryExtension(display, &ev, &er, &maj, &min))
+		die("bench: no XTest extension");
+	for (i = 0; i < CONNECTIONS; i++)
+		if (!(connections[i] = XOpenDisplay(NULL)))
+			die("bench: cannot open display");
+	printf("%-12s %6s %10s %10s %10s %10s %8s\n",
+		"scenario", "n", "ms", "requests", "roundtrips", "layout_ms", "rss_kb");
+	for (i = 2; i < argc; i++)
+		if ((n = atoi(argv[i])) > 0)
+			run(argv[1], n);
+	for (i = 0; i < CONNECTIONS; i++)
+		XCloseDisplay(connections[i]);
+	XCloseDisplay(display);
+	return EXIT_SUCCESS;
+}
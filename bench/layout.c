@@ -0,0 +1,54 @@
+/* layout microbenchmark: times the layout functions alone, no X server
+ * needed. Reports nanoseconds per pass and per client. See layout.h. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../layout.h"
+#include "../util.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define PASSES                  1000
+
+struct layout
+{
+	const char * name;
+	void (* arrange) (const struct layoutarea *a, struct geometry *g, unsigned int n);
+};
+
+static const struct layout layouts[] = {
+	{ "tile",           tile },
+	{ "monocle",        monocle },
+	{ "grid",           grid },
+	{ "centeredmaster", centeredmaster },
+	{ "bstack",         bstack },
+	{ "spiral",         spiral },
+};
+
+static const unsigned int counts[] = { 10, 100, 1000, 10000 };
+
+int main(void)
+{
+	const struct layoutarea area = { 0, 0, 1920, 1080, 0.55, 1 };
+	struct geometry *g;
+	struct timespec t0, t1;
+	unsigned int i, j, k;
+	unsigned long sum = 0;
+	double ns;
+	g = ecalloc(counts[LENGTH(counts) - 1], sizeof(struct geometry));
+	printf("%-16s %6s %12s %10s\n", "layout", "n", "ns/pass", "ns/client");
+	for (i = 0; i < LENGTH(layouts); i++)
+		for (j = 0; j < LENGTH(counts); j++) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for (k = 0; k < PASSES; k++) {
+				layouts[i].arrange(&area, g, counts[j]);
+				sum += g[k % counts[j]].w; /* keep the passes */
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / PASSES;
+			printf("%-16s %6u %12.0f %10.2f\n", layouts[i].name, counts[j],
+				ns, ns / counts[j]);
+		}
+	free(g);
+	return sum ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+# runs bench/bench against sdwm on headless Xvfb servers, once with a
+# single screen and once with two screens joined by Xinerama
+
+SDWM=${SDWM:-./sdwm}
+BENCH=${BENCH:-./bench/bench}
+CLIENTS=${CLIENTS:-"10 100 1000 10000"}
+DISPLAYNUM=${DISPLAYNUM:-99}
+
+command -v Xvfb >/dev/null || { echo "bench: Xvfb not found" >&2; exit 1; }
+
+bench() {
+	echo "# $1"
+	shift
+	Xvfb :$DISPLAYNUM -nolisten tcp "$@" >/dev/null 2>&1 &
+	xvfb=$!
+	DISPLAY=:$DISPLAYNUM $BENCH $SDWM $CLIENTS
+	status=$?
+	kill $xvfb
+	wait $xvfb 2>/dev/null
+	return $status
+}
+
+bench "single head" -screen 0 1920x1080x24 &&
+bench "xinerama, two heads" +xinerama -screen 0 1920x1080x24 -screen 1 1920x1080x24
@@ -0,0 +1,911 @@
+/* null X backend: the part of Xlib and xcb sdwm uses, answered from memory
+ * and fed with a trace sdwm -r recorded. Linked in place of the X libraries
+ * it makes bench/replay, which runs the unchanged window manager core on
+ * $SDWM_TRACE without a server and reports what it cost. */
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xlibint.h>
+#include <X11/XKBlib.h>
+#include <X11/Xlib-xcb.h>
+#ifdef XINERAMA
+#include <X11/extensions/Xinerama.h>
+#endif /* XINERAMA */
+#include <xcb/xcb.h>
+#ifdef RANDR
+#include <xcb/randr.h>
+#include <xcb/xcbext.h> /* xcb_extension_t */
+#endif /* RANDR */
+
+#include "../trace.h"
+#include "../util.h"
+
+#define WINDOWHASH              1024
+#define COOKIES                 4096 /* replies outstanding at once, at most */
+
+struct window
+{
+	Window id;
+	int x, y, w, h, bw;
+	int mapped;
+	struct window * next;
+};
+
+static void fillevent(XEvent *ev, const struct tracerecord *r);
+static struct window * findwindow(Window id, int create);
+static void forgetwindow(Window id);
+static int nextrecord(XEvent *ev);
+static unsigned int request(void);
+static void *reply(size_t size);
+
+static Display display;
+static Screen screen;
+static struct traceheader header;
+static struct tracerect * rects;
+static uint32_t * atoms;
+static struct tracewindow * initial;
+static struct tracerecord * records;
+static size_t nrecords, cursor;
+static size_t released = -1; /* batch XPending() already reported empty */
+static int ending; /* trace exhausted, see XPending() */
+static struct window * windows[WINDOWHASH];
+static Window cookie_window[COOKIES];
+static Window next_window = 0x7f000000; /* for sdwm's own windows */
+static int pointer_x, pointer_y;
+static int input[2];
+static struct timespec started;
+static unsigned long focus_failed; /* XSetInputFocus() on unmapped windows */
+static xcb_connection_t * connection = (xcb_connection_t *)&display;
+
+void fillevent(XEvent *ev, const struct tracerecord *r)
+{
+	struct window *w;
+	memset(ev, 0, sizeof *ev);
+	ev->type = r->type;
+	ev->xany.serial = display.last_request_read = display.request;
+	ev->xany.send_event = r->mode;
+	ev->xany.display = &display;
+	ev->xany.window = r->window;
+	switch (r->type) {
+	case ButtonPress:
+	case ButtonRelease:
+		ev->xbutton.root = header.root;
+		ev->xbutton.button = r->detail;
+		ev->xbutton.subwindow = r->other;
+		ev->xbutton.state = r->state;
+		ev->xbutton.x_root = pointer_x = r->x;
+		ev->xbutton.y_root = pointer_y = r->y;
+		ev->xbutton.x = r->w;
+		ev->xbutton.y = r->h;
+		ev->xbutton.time = r->data[0];
+		ev->xbutton.same_screen = True;
+		break;
+	case MotionNotify:
+		ev->xmotion.root = header.root;
+		ev->xmotion.subwindow = r->other;
+		ev->xmotion.state = r->state;
+		ev->xmotion.x_root = pointer_x = r->x;
+		ev->xmotion.y_root = pointer_y = r->y;
+		ev->xmotion.x = r->w;
+		ev->xmotion.y = r->h;
+		ev->xmotion.time = r->data[0];
+		ev->xmotion.same_screen = True;
+		break;
+	case KeyPress:
+	case KeyRelease:
+		ev->xkey.root = header.root;
+		ev->xkey.keycode = r->detail;
+		ev->xkey.subwindow = r->other;
+		ev->xkey.state = r->state;
+		ev->xkey.x_root = pointer_x = r->x;
+		ev->xkey.y_root = pointer_y = r->y;
+		ev->xkey.x = r->w;
+		ev->xkey.y = r->h;
+		ev->xkey.time = r->data[0];
+		ev->xkey.same_screen = True;
+		break;
+	case EnterNotify:
+	case LeaveNotify:
+		ev->xcrossing.send_event = False;
+		ev->xcrossing.root = header.root;
+		ev->xcrossing.mode = r->mode;
+		ev->xcrossing.detail = r->detail;
+		ev->xcrossing.subwindow = r->other;
+		ev->xcrossing.state = r->state;
+		ev->xcrossing.x_root = pointer_x = r->x;
+		ev->xcrossing.y_root = pointer_y = r->y;
+		ev->xcrossing.x = r->w;
+		ev->xcrossing.y = r->h;
+		ev->xcrossing.time = r->data[0];
+		ev->xcrossing.same_screen = True;
+		break;
+	case FocusIn:
+	case FocusOut:
+		ev->xfocus.send_event = False;
+		ev->xfocus.mode = r->mode;
+		ev->xfocus.detail = r->detail;
+		break;
+	case ConfigureRequest:
+		ev->xconfigurerequest.parent = r->data[1];
+		ev->xconfigurerequest.window = r->window;
+		ev->xconfigurerequest.above = r->other;
+		ev->xconfigurerequest.detail = r->detail;
+		ev->xconfigurerequest.value_mask = r->state;
+		ev->xconfigurerequest.x = r->x;
+		ev->xconfigurerequest.y = r->y;
+		ev->xconfigurerequest.width = r->w;
+		ev->xconfigurerequest.height = r->h;
+		ev->xconfigurerequest.border_width = r->data[0];
+		break;
+	case ConfigureNotify:
+		ev->xconfigure.event = r->data[1];
+		ev->xconfigure.window = r->window;
+		ev->xconfigure.above = r->other;
+		ev->xconfigure.x = r->x;
+		ev->xconfigure.y = r->y;
+		ev->xconfigure.width = r->w;
+		ev->xconfigure.height = r->h;
+		ev->xconfigure.border_width = r->data[0];
+		break;
+	case MapRequest:
+		ev->xmaprequest.parent = r->other;
+		ev->xmaprequest.window = r->window;
+		findwindow(r->window, 1);
+		break;
+	case DestroyNotify:
+		ev->xdestroywindow.event = r->other;
+		ev->xdestroywindow.window = r->window;
+		forgetwindow(r->window);
+		break;
+	case UnmapNotify:
+		ev->xunmap.event = r->other;
+		ev->xunmap.window = r->window;
+		ev->xunmap.from_configure = r->state;
+		if ((w = findwindow(r->window, 0)))
+			w->mapped = 0;
+		break;
+	case PropertyNotify:
+		ev->xproperty.atom = r->other;
+		ev->xproperty.state = r->state;
+		ev->xproperty.time = r->data[0];
+		break;
+	case ClientMessage:
+		ev->xclient.format = r->detail;
+		ev->xclient.message_type = r->other;
+		ev->xclient.data.l[0] = r->state;
+		ev->xclient.data.l[1] = r->data[0];
+		ev->xclient.data.l[2] = r->data[1];
+		break;
+	case MappingNotify:
+		ev->xmapping.request = r->detail;
+		ev->xmapping.first_keycode = r->x;
+		ev->xmapping.count = r->y;
+		break;
+	case Expose:
+		ev->xexpose.count = r->state;
+		ev->xexpose.x = r->x;
+		ev->xexpose.y = r->y;
+		ev->xexpose.width = r->w;
+		ev->xexpose.height = r->h;
+		break;
+	}
+}
+
+/* windows sdwm was told about, with the geometry it gave them */
+struct window * findwindow(Window id, int create)
+{
+	struct window **w;
+	for (w = &windows[id % WINDOWHASH]; *w && (*w)->id != id; w = &(*w)->next);
+	if (!*w && create) {
+		*w = ecalloc(1, sizeof(struct window));
+		(*w)->id = id;
+		(*w)->w = (*w)->h = 1;
+	}
+	return *w;
+}
+
+void forgetwindow(Window id)
+{
+	struct window **w, *f;
+	for (w = &windows[id % WINDOWHASH]; *w && (*w)->id != id; w = &(*w)->next);
+	if ((f = *w)) {
+		*w = f->next;
+		free(f);
+	}
+}
+
+/* the next record for any read, exits where the trace ends mid drag */
+int nextrecord(XEvent *ev)
+{
+	if (cursor == nrecords) {
+		XCloseDisplay(&display);
+		exit(EXIT_SUCCESS);
+	}
+	fillevent(ev, &records[cursor++]);
+	return 0;
+}
+
+unsigned int request(void)
+{
+	return ++display.request;
+}
+
+void *reply(size_t size)
+{
+	return ecalloc(1, size);
+}
+
+Status XAllocNamedColor(Display *dpy, Colormap cmap, _Xconst char *name, XColor *screen_def, XColor *exact)
+{
+	request();
+	screen_def->pixel = exact->pixel = strlen(name);
+	return 1;
+}
+
+int XAllowEvents(Display *dpy, int mode, Time time)
+{
+	request();
+	return 1;
+}
+
+int XChangeProperty(Display *dpy, Window w, Atom property, Atom type, int format, int mode,
+	_Xconst unsigned char *data, int n)
+{
+	request();
+	return 1;
+}
+
+int XChangeWindowAttributes(Display *dpy, Window w, unsigned long mask, XSetWindowAttributes *wa)
+{
+	request();
+	return 1;
+}
+
+/* only hands out what the same check returned while recording */
+Bool XCheckIfEvent(Display *dpy, XEvent *ev, Bool (*predicate)(Display *, XEvent *, XPointer), XPointer arg)
+{
+	if (cursor == nrecords || records[cursor].source != TraceCheck)
+		return False;
+	fillevent(ev, &records[cursor++]);
+	return True;
+}
+
+int XCloseDisplay(Display *dpy)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	fprintf(stderr, "replay: events %zu requests %lu ms %.2f focus failed %lu\n", cursor,
+		display.request, (t.tv_sec - started.tv_sec) * 1e3 + (t.tv_nsec - started.tv_nsec) / 1e6,
+		focus_failed);
+	return 0;
+}
+
+int XConfigureWindow(Display *dpy, Window id, unsigned int mask, XWindowChanges *wc)
+{
+	struct window *w = findwindow(id, 1);
+	request();
+	if (mask & CWX)
+		w->x = wc->x;
+	if (mask & CWY)
+		w->y = wc->y;
+	if (mask & CWWidth)
+		w->w = wc->width;
+	if (mask & CWHeight)
+		w->h = wc->height;
+	if (mask & CWBorderWidth)
+		w->bw = wc->border_width;
+	return 1;
+}
+
+Cursor XCreateFontCursor(Display *dpy, unsigned int shape)
+{
+	request();
+	return next_window++;
+}
+
+Window XCreateSimpleWindow(Display *dpy, Window parent, int x, int y, unsigned int w,
+	unsigned int h, unsigned int bw, unsigned long border, unsigned long background)
+{
+	request();
+	return next_window++;
+}
+
+int XDeleteProperty(Display *dpy, Window w, Atom property)
+{
+	request();
+	return 1;
+}
+
+int XDestroyWindow(Display *dpy, Window w)
+{
+	request();
+	return 1;
+}
+
+int XDisplayKeycodes(Display *dpy, int *min, int *max)
+{
+	*min = header.minkeycode;
+	*max = header.maxkeycode;
+	return 1;
+}
+
+Bool (*XESetWireToEvent(Display *dpy, int event, Bool (*proc)(Display *, XEvent *, xEvent *)))
+	(Display *, XEvent *, xEvent *)
+{
+	return NULL;
+}
+
+/* what the drain this batch came from read past its first event */
+int XEventsQueued(Display *dpy, int mode)
+{
+	size_t i;
+	for (i = cursor; i < nrecords && records[i].source == TraceQueued; i++);
+	return i - cursor;
+}
+
+int XFlush(Display *dpy)
+{
+	return 1;
+}
+
+int XFree(void *data)
+{
+	free(data);
+	return 1;
+}
+
+int XFreeCursor(Display *dpy, Cursor cursor)
+{
+	request();
+	return 1;
+}
+
+int XGetWindowProperty(Display *dpy, Window w, Atom property, long offset, long length,
+	Bool delete, Atom type, Atom *actual_type, int *actual_format, unsigned long *n,
+	unsigned long *after, unsigned char **data)
+{
+	request();
+	*actual_type = None;
+	*actual_format = 0;
+	*n = *after = 0;
+	*data = NULL;
+	return Success;
+}
+
+xcb_connection_t *XGetXCBConnection(Display *dpy)
+{
+	return connection;
+}
+
+int XGrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window w,
+	Bool owner_events, unsigned int mask, int pointer_mode, int keyboard_mode,
+	Window confine_to, Cursor cursor)
+{
+	request();
+	return 1;
+}
+
+int XGrabKey(Display *dpy, int keycode, unsigned int modifiers, Window w, Bool owner_events,
+	int pointer_mode, int keyboard_mode)
+{
+	request();
+	return 1;
+}
+
+int XGrabPointer(Display *dpy, Window w, Bool owner_events, unsigned int mask,
+	int pointer_mode, int keyboard_mode, Window confine_to, Cursor cursor, Time time)
+{
+	request();
+	return GrabSuccess;
+}
+
+int XGrabServer(Display *dpy)
+{
+	request();
+	return 1;
+}
+
+/* sdwm interns all its atoms in one call, in the order it recorded them */
+Status XInternAtoms(Display *dpy, char **names, int n, Bool only_if_exists, Atom *ret)
+{
+	int i;
+	request();
+	for (i = 0; i < n; i++)
+		ret[i] = i < header.natoms ? atoms[i] : XA_LAST_PREDEFINED + 1 + i;
+	return 1;
+}
+
+KeySym XkbKeycodeToKeysym(Display *dpy,
+#if NeedWidePrototypes
+	unsigned int keycode,
+#else
+	KeyCode keycode,
+#endif
+	int group, int level)
+{
+	return header.keysyms[keycode & 0xff];
+}
+
+KeyCode XKeysymToKeycode(Display *dpy, KeySym sym)
+{
+	unsigned int k;
+	for (k = header.minkeycode; k <= header.maxkeycode; k++)
+		if (sym != NoSymbol && header.keysyms[k] == sym)
+			return k;
+	return 0;
+}
+
+int XKillClient(Display *dpy, XID resource)
+{
+	request();
+	return 1;
+}
+
+int XMapWindow(Display *dpy, Window w)
+{
+	request();
+	findwindow(w, 1)->mapped = 1;
+	return 1;
+}
+
+int XMaskEvent(Display *dpy, long mask, XEvent *ev)
+{
+	return nextrecord(ev);
+}
+
+int XMoveResizeWindow(Display *dpy, Window id, int x, int y, unsigned int width, unsigned int height)
+{
+	struct window *w = findwindow(id, 1);
+	request();
+	w->x = x;
+	w->y = y;
+	w->w = width;
+	w->h = height;
+	return 1;
+}
+
+int XMoveWindow(Display *dpy, Window id, int x, int y)
+{
+	struct window *w = findwindow(id, 1);
+	request();
+	w->x = x;
+	w->y = y;
+	return 1;
+}
+
+/* fails once the trace is exhausted, which makes sdwm leave its loop */
+int XNextEvent(Display *dpy, XEvent *ev)
+{
+	if (cursor == nrecords)
+		return 1;
+	return nextrecord(ev);
+}
+
+int XNoOp(Display *dpy)
+{
+	request();
+	return 1;
+}
+
+/* loads $SDWM_TRACE and builds the screen it was recorded on */
+Display *XOpenDisplay(_Xconst char *name)
+{
+	FILE *f;
+	long size;
+	unsigned char *data, *p;
+	size_t i;
+	struct window *w;
+	if (!getenv("SDWM_TRACE"))
+		die("replay: SDWM_TRACE is not set");
+	if (!(f = fopen(getenv("SDWM_TRACE"), "r")))
+		die("replay: fopen %s:", getenv("SDWM_TRACE"));
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	p = data = ecalloc(1, size + 1);
+	if (fread(data, 1, size, f) != size)
+		die("replay: short read");
+	fclose(f);
+	if (size < sizeof header)
+		die("replay: not a trace");
+	memcpy(&header, p, sizeof header);
+	if (header.magic != TRACEMAGIC || header.version != TRACEVERSION)
+		die("replay: not a version %d trace", TRACEVERSION);
+	p += sizeof header;
+	rects = (struct tracerect *)p;
+	p += header.nmonitors * sizeof(struct tracerect);
+	atoms = (uint32_t *)p;
+	p += header.natoms * sizeof(uint32_t);
+	initial = (struct tracewindow *)p;
+	p += header.nwindows * sizeof(struct tracewindow);
+	if (p > data + size)
+		die("replay: truncated trace");
+	records = (struct tracerecord *)p;
+	nrecords = (data + size - p) / sizeof(struct tracerecord);
+	for (i = 0; i < header.nwindows; i++) {
+		w = findwindow(initial[i].window, 1);
+		w->x = initial[i].r.x;
+		w->y = initial[i].r.y;
+		w->w = initial[i].r.w;
+		w->h = initial[i].r.h;
+		w->mapped = 1;
+	}
+	/* never readable, sdwm only polls it once XPending() says empty */
+	if (pipe(input) == -1)
+		die("pipe:");
+	screen.display = &display;
+	screen.root = header.root;
+	screen.width = header.width;
+	screen.height = header.height;
+	screen.root_depth = 24;
+	display.fd = input[0];
+	display.display_name = "replay";
+	display.nscreens = 1;
+	display.screens = &screen;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	return &display;
+}
+
+/* empty once at the start of each recorded batch, so sdwm lays out as
+ * often as it did; at the end of the trace empty twice, with SIGUSR1
+ * raised so sdwm dumps its counters before XNextEvent() fails */
+int XPending(Display *dpy)
+{
+	if (cursor == nrecords) {
+		if (ending == 0)
+			raise(SIGUSR1);
+		return ending++ < 2 ? 0 : 1;
+	}
+	if (records[cursor].source == TraceBatch && released != cursor) {
+		released = cursor;
+		return 0;
+	}
+	return 1 + XEventsQueued(dpy, QueuedAfterReading);
+}
+
+/* the clients sdwm managed when recording began */
+Status XQueryTree(Display *dpy, Window w, Window *root, Window *parent, Window **children,
+	unsigned int *n)
+{
+	size_t i;
+	request();
+	*root = header.root;
+	*parent = None;
+	*n = header.nwindows;
+	*children = ecalloc(header.nwindows + 1, sizeof(Window));
+	for (i = 0; i < header.nwindows; i++)
+		(*children)[i] = initial[i].window;
+	return 1;
+}
+
+int XRaiseWindow(Display *dpy, Window w)
+{
+	request();
+	return 1;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev)
+{
+	return 1;
+}
+
+int XSelectInput(Display *dpy, Window w, long mask)
+{
+	request();
+	return 1;
+}
+
+int XSetCloseDownMode(Display *dpy, int mode)
+{
+	request();
+	return 1;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler)
+{
+	return NULL;
+}
+
+/* a window that exists but is not viewable cannot take the focus, the
+ * server answers BadMatch and the focus stays where it was; windows the
+ * trace already destroyed are not counted, sdwm cannot know in time */
+int XSetInputFocus(Display *dpy, Window w, int revert_to, Time time)
+{
+	struct window *f;
+	request();
+	if ((f = findwindow(w, 0)) && !f->mapped)
+		focus_failed++;
+	return 1;
+}
+
+int XSetWindowBorder(Display *dpy, Window w, unsigned long pixel)
+{
+	request();
+	return 1;
+}
+
+Bool XSupportsLocale(void)
+{
+	return True;
+}
+
+int XSync(Display *dpy, Bool discard)
+{
+	request();
+	display.last_request_read = display.request;
+	return 1;
+}
+
+int XUngrabButton(Display *dpy, unsigned int button, unsigned int modifiers, Window w)
+{
+	request();
+	return 1;
+}
+
+int XUngrabKey(Display *dpy, int keycode, unsigned int modifiers, Window w)
+{
+	request();
+	return 1;
+}
+
+int XUngrabPointer(Display *dpy, Time time)
+{
+	request();
+	return 1;
+}
+
+int XUngrabServer(Display *dpy)
+{
+	request();
+	return 1;
+}
+
+int XWarpPointer(Display *dpy, Window src, Window dest, int src_x, int src_y,
+	unsigned int src_width, unsigned int src_height, int x, int y)
+{
+	struct window *w;
+	request();
+	if ((w = findwindow(dest, 0))) {
+		pointer_x = w->x + x;
+		pointer_y = w->y + y;
+	}
+	return 1;
+}
+
+#ifdef XINERAMA
+Bool XineramaIsActive(Display *dpy)
+{
+	return header.nmonitors > 0;
+}
+
+XineramaScreenInfo *XineramaQueryScreens(Display *dpy, int *n)
+{
+	XineramaScreenInfo *info;
+	int i;
+	request();
+	info = ecalloc(header.nmonitors, sizeof(XineramaScreenInfo));
+	for (i = 0; i < header.nmonitors; i++) {
+		info[i].screen_number = i;
+		info[i].x_org = rects[i].x;
+		info[i].y_org = rects[i].y;
+		info[i].width = rects[i].w;
+		info[i].height = rects[i].h;
+	}
+	*n = header.nmonitors;
+	return info;
+}
+#endif /* XINERAMA */
+
+/* no second connection, so sdwm runs without its fetch thread and every
+ * replay does the same requests in the same order */
+xcb_connection_t *xcb_connect(const char *name, int *screen)
+{
+	return NULL;
+}
+
+int xcb_connection_has_error(xcb_connection_t *c)
+{
+	return c != connection;
+}
+
+void xcb_discard_reply(xcb_connection_t *c, unsigned int sequence)
+{
+}
+
+void xcb_disconnect(xcb_connection_t *c)
+{
+}
+
+int xcb_flush(xcb_connection_t *c)
+{
+	return 1;
+}
+
+/* no extensions, RandR included */
+const xcb_query_extension_reply_t *xcb_get_extension_data(xcb_connection_t *c, xcb_extension_t *ext)
+{
+	static xcb_query_extension_reply_t absent;
+	return &absent;
+}
+
+xcb_get_geometry_cookie_t xcb_get_geometry(xcb_connection_t *c, xcb_drawable_t drawable)
+{
+	xcb_get_geometry_cookie_t cookie = { request() };
+	cookie_window[cookie.sequence % COOKIES] = drawable;
+	return cookie;
+}
+
+xcb_get_geometry_reply_t *xcb_get_geometry_reply(xcb_connection_t *c,
+	xcb_get_geometry_cookie_t cookie, xcb_generic_error_t **e)
+{
+	xcb_get_geometry_reply_t *r;
+	struct window *w = findwindow(cookie_window[cookie.sequence % COOKIES], 0);
+	if (!w)
+		return NULL;
+	r = reply(sizeof *r);
+	r->x = w->x;
+	r->y = w->y;
+	r->width = w->w;
+	r->height = w->h;
+	r->border_width = w->bw;
+	return r;
+}
+
+xcb_get_modifier_mapping_cookie_t xcb_get_modifier_mapping(xcb_connection_t *c)
+{
+	xcb_get_modifier_mapping_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_keycode_t *xcb_get_modifier_mapping_keycodes(const xcb_get_modifier_mapping_reply_t *r)
+{
+	return (xcb_keycode_t *)(r + 1);
+}
+
+/* recorded modifier state carries no lock bits, so nothing is numlock */
+xcb_get_modifier_mapping_reply_t *xcb_get_modifier_mapping_reply(xcb_connection_t *c,
+	xcb_get_modifier_mapping_cookie_t cookie, xcb_generic_error_t **e)
+{
+	return reply(sizeof(xcb_get_modifier_mapping_reply_t));
+}
+
+/* clients set no properties */
+xcb_get_property_cookie_t xcb_get_property(xcb_connection_t *c, uint8_t delete,
+	xcb_window_t window, xcb_atom_t property, xcb_atom_t type, uint32_t offset, uint32_t length)
+{
+	xcb_get_property_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_get_property_reply_t *xcb_get_property_reply(xcb_connection_t *c,
+	xcb_get_property_cookie_t cookie, xcb_generic_error_t **e)
+{
+	return reply(sizeof(xcb_get_property_reply_t));
+}
+
+void *xcb_get_property_value(const xcb_get_property_reply_t *r)
+{
+	return (void *)(r + 1);
+}
+
+int xcb_get_property_value_length(const xcb_get_property_reply_t *r)
+{
+	return r->value_len * (r->format / 8);
+}
+
+xcb_get_window_attributes_cookie_t xcb_get_window_attributes(xcb_connection_t *c, xcb_window_t window)
+{
+	xcb_get_window_attributes_cookie_t cookie = { request() };
+	cookie_window[cookie.sequence % COOKIES] = window;
+	return cookie;
+}
+
+xcb_get_window_attributes_reply_t *xcb_get_window_attributes_reply(xcb_connection_t *c,
+	xcb_get_window_attributes_cookie_t cookie, xcb_generic_error_t **e)
+{
+	xcb_get_window_attributes_reply_t *r;
+	struct window *w = findwindow(cookie_window[cookie.sequence % COOKIES], 0);
+	if (!w)
+		return NULL;
+	r = reply(sizeof *r);
+	r->map_state = w->mapped ? XCB_MAP_STATE_VIEWABLE : XCB_MAP_STATE_UNMAPPED;
+	return r;
+}
+
+xcb_query_pointer_cookie_t xcb_query_pointer(xcb_connection_t *c, xcb_window_t window)
+{
+	xcb_query_pointer_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_query_pointer_reply_t *xcb_query_pointer_reply(xcb_connection_t *c,
+	xcb_query_pointer_cookie_t cookie, xcb_generic_error_t **e)
+{
+	xcb_query_pointer_reply_t *r = reply(sizeof *r);
+	r->same_screen = 1;
+	r->root = header.root;
+	r->root_x = pointer_x;
+	r->root_y = pointer_y;
+	return r;
+}
+
+#ifdef RANDR
+/* never called, xcb_get_extension_data() reports RandR absent */
+xcb_extension_t xcb_randr_id;
+
+xcb_randr_get_crtc_info_cookie_t xcb_randr_get_crtc_info(xcb_connection_t *c,
+	xcb_randr_crtc_t crtc, xcb_timestamp_t timestamp)
+{
+	xcb_randr_get_crtc_info_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_randr_get_crtc_info_reply_t *xcb_randr_get_crtc_info_reply(xcb_connection_t *c,
+	xcb_randr_get_crtc_info_cookie_t cookie, xcb_generic_error_t **e)
+{
+	return NULL;
+}
+
+xcb_randr_get_screen_resources_current_cookie_t xcb_randr_get_screen_resources_current(
+	xcb_connection_t *c, xcb_window_t window)
+{
+	xcb_randr_get_screen_resources_current_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_randr_crtc_t *xcb_randr_get_screen_resources_current_crtcs(
+	const xcb_randr_get_screen_resources_current_reply_t *r)
+{
+	return NULL;
+}
+
+int xcb_randr_get_screen_resources_current_crtcs_length(
+	const xcb_randr_get_screen_resources_current_reply_t *r)
+{
+	return 0;
+}
+
+xcb_randr_mode_info_t *xcb_randr_get_screen_resources_current_modes(
+	const xcb_randr_get_screen_resources_current_reply_t *r)
+{
+	return NULL;
+}
+
+int xcb_randr_get_screen_resources_current_modes_length(
+	const xcb_randr_get_screen_resources_current_reply_t *r)
+{
+	return 0;
+}
+
+xcb_randr_get_screen_resources_current_reply_t *xcb_randr_get_screen_resources_current_reply(
+	xcb_connection_t *c, xcb_randr_get_screen_resources_current_cookie_t cookie,
+	xcb_generic_error_t **e)
+{
+	return NULL;
+}
+
+xcb_randr_query_version_cookie_t xcb_randr_query_version(xcb_connection_t *c,
+	uint32_t major, uint32_t minor)
+{
+	xcb_randr_query_version_cookie_t cookie = { request() };
+	return cookie;
+}
+
+xcb_randr_query_version_reply_t *xcb_randr_query_version_reply(xcb_connection_t *c,
+	xcb_randr_query_version_cookie_t cookie, xcb_generic_error_t **e)
+{
+	return NULL;
+}
+
+xcb_void_cookie_t xcb_randr_select_input(xcb_connection_t *c, xcb_window_t window, uint16_t enable)
+{
+	xcb_void_cookie_t cookie = { request() };
+	return cookie;
+}
+#endif /* RANDR */
@@ -6,16 +6,29 @@ static const unsigned int snap      = 32;       /* snap pixel */
 static const char *color_scheme[]    = {
 	[ColorNormal] = "#444444",
 	[ColorSelected]  = "#009900",
+	[ColorUrgent]    = "#990000",
 };
 
 static const unsigned int ntags = 9;
 
 static const float mfact     = 0.55; /* factor of master area size [0.05..0.95] */
 static const int nmasters     = 1;    /* number of clients in master area */
+static const int resizehints = 1;    /* 1 means respect size hints in tiled resizals, leaving gaps */
 
 static const int lockfullscreen = 1; /* 1 will force focus on the fullscreen window */
 
-static const void (* layouts[]) (struct monitor *) = { tile, monocle, 0 };
+/* a new window is placed by the first rule for its class and instance,
+ * else for its class, its instance, or neither; NULL matches anything,
+ * title a substring of the window's; title and role rules cost a property
+ * fetch per window */
+static const struct rule rules[] = {
+	/* class      instance    title       role        tags mask  monitor  floating  x, y, w, h */
+	{ "Gimp",     NULL,       NULL,       NULL,       0,         -1,      1 },
+};
+
+static const void (* layouts[]) (const struct layoutarea *, struct geometry *, unsigned int) = {
+	tile, monocle, grid, centeredmaster, bstack, spiral, 0
+};
 
 #define TAGKEYS(KEY,TAG) \
 	{ MODKEY,                         KEY,      view,           {.ui = 1 << TAG} }, \
@@ -42,7 +55,11 @@ static const struct key keys[] = {
 
 	{ MODKEY,                       XK_t,      setlayout,      {.v = &layouts[0]} },
 	{ MODKEY,                       XK_m,      setlayout,      {.v = &layouts[1]} },
-	{ MODKEY,                       XK_f,      setlayout,      {.v = &layouts[2]} },
+	{ MODKEY,                       XK_f,      setlayout,      {.v = &layouts[6]} },
+	{ MODKEY,                       XK_g,      setlayout,      {.v = &layouts[2]} },
+	{ MODKEY,                       XK_u,      setlayout,      {.v = &layouts[3]} },
+	{ MODKEY,                       XK_b,      setlayout,      {.v = &layouts[4]} },
+	{ MODKEY,                       XK_r,      setlayout,      {.v = &layouts[5]} },
 	{ MODKEY,                       XK_space,  setlayout,      {0} },
 
 	{ MODKEY | ShiftMask,             XK_space,  togglefloating, {0} },
@@ -68,6 +85,7 @@ static const struct key keys[] = {
 	TAGKEYS(                        XK_9,                      8)
 
 	{ MODKEY|ShiftMask,             XK_q,      quit,           {0} },
+	{ MODKEY|ShiftMask,             XK_r,      restart,        {0} },
 };
 
 /* button definitions */
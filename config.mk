@@ -11,16 +11,29 @@ X11LIB = -L /usr/X11R6/lib
 XINERAMALIBS  = -l Xinerama
 XINERAMAFLAGS = -D XINERAMA
 
+# RandR (xcb-randr) for monitor hotplug and refresh rates, comment if you don't want it
+RANDRLIBS  = -l xcb-randr
+RANDRFLAGS = -D RANDR
+
+# xcb, used for pipelined requests on the Xlib connection
+XCBLIBS = -l X11-xcb -l xcb
+
+# the fetch thread
+THREADLIBS = -l pthread
+
 # includes and libs
 INCS = ${X11INC}
-LIBS = ${X11LIB} -l X11 ${XINERAMALIBS}
+LIBS = ${X11LIB} -l X11 ${XINERAMALIBS} ${RANDRLIBS} ${XCBLIBS} ${THREADLIBS}
 
 # flags
-CPPFLAGS = -D VERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPFLAGS = -D_DEFAULT_SOURCE -D_POSIX_C_SOURCE=200809L -D VERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${RANDRFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c17 -pedantic -Wall -Wno-deprecated-declarations -Os ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
 
+# make bench, needs Xvfb at run time
+BENCHLIBS = ${X11LIB} -l X11 -l Xtst ${RANDRLIBS} ${XCBLIBS}
+
 # Solaris
 #CFLAGS = -fast ${INCS} -DVERSION=\"${VERSION}\"
 #LDFLAGS = ${LIBS}
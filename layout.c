@@ -0,0 +1,141 @@
+#include <stddef.h>
+
+#include "layout.h"
+#include "util.h"
+
+/* masters side by side on top, the stack side by side below them */
+void bstack(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i, nm, mh, mx, tx, w;
+	nm = MIN(n, (unsigned int)a->nmasters);
+	if (n > nm)
+		mh = nm ? a->h * a->mfact : 0;
+	else
+		mh = a->h;
+	for (i = mx = tx = 0; i < n; i++)
+		if (i < nm) {
+			w = (a->w - mx) / (nm - i);
+			g[i] = (struct geometry){ a->x + mx, a->y, w, mh };
+			mx += w;
+		} else {
+			w = (a->w - tx) / (n - i);
+			g[i] = (struct geometry){ a->x + tx, a->y + mh, w, a->h - mh };
+			tx += w;
+		}
+}
+
+/* masters in a centred column, the stack alternating between a column on
+ * the right and one on the left */
+void centeredmaster(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i, k, nm, ns, h, mw, mx = 0, my = 0, ly = 0, ry = 0;
+	nm = MIN(n, (unsigned int)a->nmasters);
+	ns = n - nm;
+	if (ns) {
+		mw = nm ? a->w * a->mfact : 0;
+		if (ns > 1)
+			mx = (a->w - mw) / 2;
+	} else
+		mw = a->w;
+	for (i = 0; i < n; i++) {
+		if (i < nm) {
+			h = (a->h - my) / (nm - i);
+			g[i] = (struct geometry){ a->x + mx, a->y + my, mw, h };
+			my += h;
+		} else if (!((k = i - nm) % 2)) {
+			h = (a->h - ry) / ((ns + 1) / 2 - k / 2);
+			g[i] = (struct geometry){ a->x + mx + mw, a->y + ry, a->w - mx - mw, h };
+			ry += h;
+		} else {
+			h = (a->h - ly) / (ns / 2 - k / 2);
+			g[i] = (struct geometry){ a->x, a->y + ly, mx, h };
+			ly += h;
+		}
+	}
+}
+
+/* rows of equal cells, the last row shares its width among what is left */
+void grid(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i, cols, rows, row, col, cells;
+	if (!n)
+		return;
+	for (cols = 1; cols * cols < n; cols++);
+	rows = (n + cols - 1) / cols;
+	for (i = 0; i < n; i++) {
+		row = i / cols;
+		col = i % cols;
+		cells = row == rows - 1 ? n - row * cols : cols;
+		g[i].x = a->x + col * a->w / cells;
+		g[i].y = a->y + row * a->h / rows;
+		g[i].w = a->x + (col + 1) * a->w / cells - g[i].x;
+		g[i].h = a->y + (row + 1) * a->h / rows - g[i].y;
+	}
+}
+
+void monocle(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i;
+	for (i = 0; i < n; i++)
+		g[i] = (struct geometry){ a->x, a->y, a->w, a->h };
+}
+
+/* each client takes part of what is left, turning clockwise inwards: the
+ * first split follows mfact, the following ones halve. Once the space left
+ * cannot be split any more the remaining clients share it */
+void spiral(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i;
+	int x = a->x, y = a->y, w = a->w, h = a->h, s;
+	for (i = 0; i + 1 < n && (i % 2 ? h : w) > 1; i++) {
+		switch (i % 4) {
+		case 0: /* left */
+			s = i ? w / 2 : w * a->mfact;
+			g[i] = (struct geometry){ x, y, s, h };
+			x += s;
+			w -= s;
+			break;
+		case 1: /* top */
+			s = h / 2;
+			g[i] = (struct geometry){ x, y, w, s };
+			y += s;
+			h -= s;
+			break;
+		case 2: /* right */
+			s = w / 2;
+			g[i] = (struct geometry){ x + w - s, y, s, h };
+			w -= s;
+			break;
+		case 3: /* bottom */
+			s = h / 2;
+			g[i] = (struct geometry){ x, y + h - s, w, s };
+			h -= s;
+			break;
+		}
+	}
+	for (; i < n; i++)
+		g[i] = (struct geometry){ x, y, w, h };
+}
+
+/* masters stacked on the left, mfact wide, the rest stacked on the right */
+void tile(const struct layoutarea *a, struct geometry *g, unsigned int n)
+{
+	unsigned int i, h, mw, my, ty, nm;
+	nm = MIN(n, (unsigned int)a->nmasters);
+	if (n > nm)
+		mw = nm ? a->w * a->mfact : 0;
+	else
+		mw = a->w;
+	for (i = my = ty = 0; i < n; i++)
+		if (i < nm) {
+			h = (a->h - my) / (nm - i);
+			g[i] = (struct geometry){ a->x, a->y + my, mw, h };
+			if (my + h < (unsigned int)a->h)
+				my += h;
+		} else {
+			h = (a->h - ty) / (n - i);
+			g[i] = (struct geometry){ a->x + mw, a->y + ty, a->w - mw, h };
+			if (ty + h < (unsigned int)a->h)
+				ty += h;
+		}
+}
@@ -0,0 +1,25 @@
+/* where a layout puts a client, border included */
+struct geometry
+{
+	int x, y, w, h;
+};
+
+/* what a layout knows about the monitor it arranges */
+struct layoutarea
+{
+	int x, y, w, h;
+	float mfact;
+	int nmasters;
+};
+
+/* layouts place the n visible tiled clients of a monitor, in list order,
+ * into g[0..n - 1] and have no other side effects. They cannot know size
+ * hints: a client that applysizehints() keeps smaller than its cell leaves
+ * the rest of the cell empty, the clients after it do not move up into it.
+ * test/layout.c checks them */
+void bstack(const struct layoutarea *a, struct geometry *g, unsigned int n);
+void centeredmaster(const struct layoutarea *a, struct geometry *g, unsigned int n);
+void grid(const struct layoutarea *a, struct geometry *g, unsigned int n);
+void monocle(const struct layoutarea *a, struct geometry *g, unsigned int n);
+void spiral(const struct layoutarea *a, struct geometry *g, unsigned int n);
+void tile(const struct layoutarea *a, struct geometry *g, unsigned int n);
@@ -1,16 +1,39 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <X11/cursorfont.h>
+#include <X11/Xatom.h>
 #include <X11/keysym.h>
+#include <X11/XKBlib.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xproto.h>
+#include <X11/Xutil.h>
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif
+#include <xcb/xcb.h>
+#ifdef RANDR
+#include <X11/Xlibint.h> /* XESetWireToEvent */
+#include <xcb/randr.h>
+#endif
 
+#include "layout.h"
+#include "trace.h"
 #include "util.h"
 
 #define BUTTONMASK              (ButtonPressMask | ButtonReleaseMask)
@@ -25,10 +48,33 @@
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define TAGMASK                 ((1 << ntags) - 1)
+#define EVENTBATCH              256
+#define LATENCYBUCKETS          16 /* powers of two in microseconds */
+#define CONTROLBUFSIZE          16384
+#define MAXCONTROLS             8
+#define STATEVERSION            1
+#define MONITORFIELDS           10
+#define CLIENTFIELDS            16
+#define GEOMSETTLE              100 /* ms output changes must be quiet for */
+#define SLABOBJECTS             256
+#define LAYOUTCACHE             4 /* tag sets per monitor whose layout is kept */
+#define FETCHQUEUE              1024 /* a power of two */
+#define POOL(T)                 { .size = (sizeof(T) + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *) }
+#define CACHEDPROPS             ((1 << PropName) - 1)
+/* Fibonacci hashing: the top bits of the product depend on every bit of
+ * the id, including the per-connection base the server puts above bit 21 */
+#define WINHASH(W)              ((uint32_t)((W) * 2654435761u) >> (32 - client_index_bits))
 
 enum { CursorNormal, CursorResize, CursorMove, CursorLast };
-enum { ColorNormal, ColorSelected };
+enum { ColorNormal, ColorSelected, ColorUrgent };
 enum { ClickClientWindow, ClickRootWindow, ClickLast };
+enum { GrabNone, GrabUnfocused, GrabFocused };
+enum { ArgNone, ArgInt, ArgFloat, ArgTag, ArgLayout, ArgWindow };
+enum { NetSupported, NetWMCheck, NetWMName, NetWMState, NetWMFullscreen,
+       NetActiveWindow, NetClientList, NetCurrentDesktop, NetNumberOfDesktops,
+       NetLast, AtomSdwmState = NetLast, AtomUTF8String, AtomWMWindowRole, AtomLast };
+enum { PropNormalHints, PropHints, PropClass, /* cached */
+       PropName, PropNetName, PropRole, PropLast }; /* only read by rules */
 
 union argument
 {
@@ -38,17 +84,49 @@ union argument
 	const void * v;
 };
 
+/* what nexttiled(), ISVISIBLE() and resize() read comes first, in one
+ * cache line; the size hints are kept here as well because
+ * applysizehints() reads them for every tiled client it resizes. The rest
+ * is in struct clientcold */
 struct client
 {
-        int x, y, w, h;
-        int oldx, oldy, oldw, oldh;
-        int bw, oldbw;
-        unsigned int tags;
-        int isfloating, oldstate, isfullscreen;
         struct client * next;
-        struct client * snext;
         struct monitor * monitor;
+        unsigned int tags;
+        int isfloating, isfullscreen, ismapped, ishidden;
+        int x, y, w, h;
+        int bw;
         Window window;
+        struct client * snext;
+        struct client * hnext;
+        struct clientcold * cold;
+        int basew, baseh, incw, inch, maxw, maxh, minw, minh; /* WM_NORMAL_HINTS */
+        float mina, maxa;
+};
+
+/* state only fullscreen, floating and grab changes need, pooled apart */
+struct clientcold
+{
+        int oldx, oldy, oldw, oldh; /* restored on leaving fullscreen or floating again */
+        int oldbw;
+        int oldstate;
+        int buttongrab; /* button grabs currently set on window */
+        unsigned int listed; /* position in client_list */
+        unsigned int stale; /* 1 << Prop* to fetch again, see refreshproperties() */
+        int border; /* Color* the border has on the server, -1 before the first */
+        int isfixed;
+        int isurgent, neverfocus; /* WM_HINTS */
+        char instance[64], class[64]; /* WM_CLASS */
+};
+
+/* a layout result for one tag set, valid while generation matches */
+struct layoutcache
+{
+        unsigned int tagset;
+        unsigned long generation;
+        unsigned int n, size;
+        struct client ** clients;
+        struct geometry * geometry;
 };
 
 struct monitor
@@ -56,6 +134,12 @@ struct monitor
         float mfact;
         int nmasters;
         int num;
+        int dirty; /* layout pass pending, see flusharrange() */
+        int refresh; /* fastest refresh rate of its outputs in Hz */
+        unsigned long arranges;
+        unsigned long generation; /* bumped when a layout input changes */
+        unsigned int cache_next; /* slot the next miss replaces */
+        struct layoutcache cache[LAYOUTCACHE];
         int mx, my, mw, mh;
         int wx, wy, ww, wh;
         unsigned int tagset[2];
@@ -65,7 +149,7 @@ struct monitor
         struct client * selected_client;
         struct client * stack;
         struct monitor * next;
-        const void (** layouts[2]) (struct monitor *);
+        const void (** layouts[2]) (const struct layoutarea *, struct geometry *, unsigned int);
 };
 
 struct button
@@ -85,67 +169,211 @@ struct key
 	const union argument argument;
 };
 
+struct rule
+{
+	const char * class;
+	const char * instance;
+	const char * title;
+	const char * role;
+	unsigned int tags; /* 0 for the monitor's current ones */
+	int monitor; /* -1 for the selected one */
+	int isfloating;
+	int x, y, w, h; /* relative to the monitor's window area, used if w and h are set */
+};
+
+struct command
+{
+	const char * name;
+	void (* function) (const union argument *);
+	unsigned int type;
+};
+
+/* a connection to the control socket and its unprocessed input */
+struct control
+{
+	int fd;
+	size_t length;
+	char buffer[CONTROLBUFSIZE];
+};
+
+/* fixed-size objects carved from slabs, freed objects are reused first */
+struct pool
+{
+	size_t size;
+	void * freelist; /* linked through the first word of each object */
+	char * next, * end; /* unused space of the newest slab */
+	void * slabs; /* linked through their first word */
+	unsigned long nslabs;
+};
+
+/* in-flight requests for what manage() needs to know about a window */
+struct windowquery
+{
+	xcb_get_window_attributes_cookie_t attributes;
+	xcb_get_geometry_cookie_t geometry;
+	xcb_get_property_cookie_t transient;
+	xcb_get_property_cookie_t properties[PropLast];
+};
+
+/* a window queued for the fetch thread, see fetchwindow() */
+struct fetch
+{
+	Window window;
+	unsigned int which; /* properties to read */
+	int manage; /* for maprequest(), otherwise a property refresh */
+	/* the main thread's while queued */
+	int cancelled;
+	unsigned long mask; /* what ConfigureRequests asked for meanwhile */
+	int x, y, w, h, bw;
+	/* the fetch thread's until fetch_done passes it */
+	int ok; /* 0 if the window is gone, -1 if the connection is */
+	XWindowAttributes wa;
+	Window trans;
+	xcb_get_property_reply_t * properties[PropLast];
+};
+
+static void applyenter(void);
+static void applyfetches(void);
+static void applyrules(struct client *c, xcb_get_property_reply_t **properties);
 static int applysizehints(struct client *c, int *x, int *y, int *w, int *h, int interact);
 static void arrange(struct monitor * monitor);
 static void arrangemon(struct monitor * monitor);
 static void attach(struct client *c);
 static void attachstack(struct client *c);
 static void buttonpress(XEvent *e);
+static void cancelfetches(Window w);
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(struct monitor *mon);
+static unsigned int compressmotion(XEvent *ev);
+static void closecontrol(struct control *ctl);
+static void compilerules(void);
+static void clientmessage(XEvent *e);
+static int coalesceevents(XEvent *queue, int n);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
+static struct client *createclient(void);
 static struct monitor *createmon(void);
 static void destroynotify(XEvent *e);
 static void detach(struct client *c);
 static void detachstack(struct client *c);
 static struct monitor *dirtomon(int dir);
+static void dispatch(XEvent *ev);
+static int drainevents(XEvent *queue, int size);
+static void dumpstats(void);
 static void enternotify(XEvent *e);
+static Window eventwindow(XEvent *ev);
+static struct fetch *fetching(Window w);
+static const struct rule *findrule(const char *class, const char *instance, const char *title, const char *role);
+static void *fetchthread(void *unused);
+static int fetchwindow(Window w, unsigned int which, int manage);
+static void flusharrange(void);
+static void flushclientlist(void);
 static void focus(struct client *c);
+static void freeclient(struct client *c);
+static void focusclient(const union argument *argument);
 static void focusin(XEvent *e);
+static void focusout(XEvent *e);
 static void focusmon(const union argument *argument);
 static void focusstack(const union argument *argument);
+static void geomchanged(void);
+static int geomwait(void);
 static int getrootptr(int *x, int *y);
 static void grabbuttons(struct client *c, int focused);
+static void grabkeycode(KeyCode keycode);
 static void grabkeys(void);
+static void growindex(void);
+static void ignorecrossings(unsigned long first);
 static void incnmaster(const union argument *argument);
+static void indexclient(struct client *c);
+static void indexmonitors(void);
+static Bool ismotion(Display *display, XEvent *ev, XPointer stop);
 static void keypress(XEvent *e);
+static unsigned int latencybucket(struct timespec *t0);
 static void killclient(const union argument *argument);
-static void manage(Window w, XWindowAttributes *wa);
+static void listclient(struct client *c);
+static void manage(Window w, XWindowAttributes *wa, Window trans, xcb_get_property_reply_t **properties);
+static void managewindow(Window w);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
-static void monocle(struct monitor *m);
+static int monitoredges(int *edges, int n);
+static unsigned int motioninterval(int x, int y);
 static void motionnotify(XEvent *e);
 static void movemouse(const union argument *argument);
 static struct client *nexttiled(struct client *c);
+static const char *parsecommand(char *line, const struct command **cmd, union argument *a);
+static struct monitor *pointtomon(int x, int y);
+static void *poolalloc(struct pool *p);
+static void poolfree(struct pool *p, void *o);
+static void poolrelease(struct pool *p);
 static void pop(struct client *c);
+static void propertynotify(XEvent *e);
+static void propertytext(xcb_get_property_reply_t *reply, char *text, size_t size);
+static void queryproperties(xcb_connection_t *x, Window w, unsigned int which, xcb_get_property_cookie_t *cookies);
+static void querywindow(xcb_connection_t *x, Window w, struct windowquery *q);
 static void quit(const union argument *argument);
+#ifdef RANDR
+static Bool randrwire(Display *display, XEvent *re, xEvent *event);
+#endif /* RANDR */
+static void readcontrol(struct control *ctl);
 static struct monitor *recttomon(int x, int y, int w, int h);
+static void refreshproperties(void);
+#if defined(RANDR) || defined(XINERAMA)
+static void removemon(struct monitor *m, struct monitor *target);
+#endif
+static void replyproperties(xcb_connection_t *x, unsigned int which, xcb_get_property_cookie_t *cookies,
+	xcb_get_property_reply_t **replies);
+static int replywindow(xcb_connection_t *x, struct windowquery *q, XWindowAttributes *wa, Window *trans);
 static void resize(struct client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(struct client *c, int x, int y, int w, int h);
 static void resizemouse(const union argument *argument);
 static void restack(struct monitor *monitor);
+static void restart(const union argument *argument);
+static int restorestate(void);
+static unsigned int rulehash(const char *class, const char *instance);
 static void run(void);
+static void savestate(void);
+static void schedulegeom(void);
+static void runcommands(struct control *ctl, char *lines, char *end);
 static void scan(void);
 static void sendmon(struct client *c, struct monitor *m);
 static void togglefullscreen(const union argument *argument);
+static void setborder(struct client *c, int color);
+static void setfullscreen(struct client *c, int fullscreen);
+static void setinputfocus(Window w);
+static void setproperties(struct client *c, unsigned int which, xcb_get_property_reply_t **replies);
 static void setlayout(const union argument *argument);
 static void setmfact(const union argument *argument);
 static void setup(void);
+static void setupcontrol(void);
 static void showhide(struct client * client);
+static void sigusr1(int unused);
+static void staleproperties(struct client *c, unsigned int which);
+static void startfetch(void);
+static void starttrace(const char *path);
+static void stopfetch(void);
 static void tag(const union argument *argument);
 static void tagmon(const union argument *argument);
-static void tile(struct monitor *m);
 static void togglefloating(const union argument *argument);
 static void toggletag(const union argument *argument);
 static void toggleview(const union argument *argument);
+static void traceevent(XEvent *ev, int source);
+static void trackpointer(XEvent *ev);
 static void unfocus(struct client *c, int setfocus);
+static void unindexclient(struct client *c);
+static void unlistclient(struct client *c);
 static void unmanage(struct client *c, int destroyed);
 static void unmapnotify(XEvent *e);
 static int updategeom(void);
+static void updatedesktop(void);
+static void updatekeytable(unsigned char *changed);
+#ifdef RANDR
+static int updateoutputs(void);
+#endif /* RANDR */
 static void updatenumlockmask(void);
 static void view(const union argument *argument);
+static void waitinput(void);
+static void wake(int fd);
 static struct client *wintoclient(Window w);
 static struct monitor *wintomon(Window w);
 static int error_handler(Display *display, XErrorEvent *ee);
@@ -154,28 +382,127 @@ static int another_wm_error_handler(Display *display, XErrorEvent *ee);
 static void zoom(const union argument *argument);
 
 static Display * display;
+static xcb_connection_t * xcb; /* same connection as display, for pipelined requests */
+static unsigned long roundtrips; /* blocking waits for the server */
+static int signal_pipe[2]; /* wakes run() from signal handlers */
+static unsigned long clients_managed;
+static unsigned long event_count[LASTEvent];
+static unsigned long event_latency[LASTEvent][LATENCYBUCKETS];
+static unsigned long slowest_us[LASTEvent];
+static Window slowest_window[LASTEvent];
+static struct client ** layout_clients; /* visible tiled clients of the monitor being arranged */
+static struct geometry * layout_geometry; /* where its layout put them */
+static unsigned int layout_size;
+static unsigned long layout_passes, layout_us, layout_cached; /* time flusharrange() spent per monitor */
+static unsigned long drag_latency[LATENCYBUCKETS]; /* motion read to configure sent */
+static unsigned long motion_dropped; /* stale motion skipped while dragging */
+static int control_fd = -1; /* listening control socket */
+static char control_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static struct control controls[MAXCONTROLS];
+static int control_batch; /* restacks wait for the end of a transaction */
 static int screen_number;
 static int screen_width, screen_height;
 static Window root_window;
 static int (* default_error_handler)(Display *, XErrorEvent *);
 static void (* handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
+	[ClientMessage] = clientmessage,
 	[ConfigureRequest] = configurerequest,
 	[ConfigureNotify] = configurenotify,
 	[DestroyNotify] = destroynotify,
 	[EnterNotify] = enternotify,
 	[FocusIn] = focusin,
+	[FocusOut] = focusout,
 	[KeyPress] = keypress,
 	[MappingNotify] = mappingnotify,
 	[MapRequest] = maprequest,
 	[MotionNotify] = motionnotify,
+	[PropertyNotify] = propertynotify,
 	[UnmapNotify] = unmapnotify
 };
+static const char * handler_name[LASTEvent] = {
+	[ButtonPress] = "buttonpress",
+	[ClientMessage] = "clientmessage",
+	[ConfigureRequest] = "configurerequest",
+	[ConfigureNotify] = "configurenotify",
+	[DestroyNotify] = "destroynotify",
+	[EnterNotify] = "enternotify",
+	[FocusIn] = "focusin",
+	[FocusOut] = "focusout",
+	[KeyPress] = "keypress",
+	[MappingNotify] = "mappingnotify",
+	[MapRequest] = "maprequest",
+	[MotionNotify] = "motionnotify",
+	[PropertyNotify] = "propertynotify",
+	[UnmapNotify] = "unmapnotify"
+};
 static int running = 1;
+static int restarting = 0;
 static Cursor cursors[CursorLast];
 static XColor * colors;
 static struct monitor * monitors, * selected_monitor;
+static struct monitor ** monitor_array; /* monitors in list order, indexed by num */
+static int nmonitors;
+static struct monitor ** monitor_grid; /* topmost monitor of each cell between monitor edges */
+static int * grid_x, * grid_y; /* sorted edges, grid_columns + 1 and grid_rows + 1 of them */
+static int grid_columns, grid_rows;
+static int pointer_x, pointer_y; /* root position reported by the event being handled */
+static int pointer_fresh;
+static int randr_event_base = -1; /* -1 without RandR notifications */
+static int geom_pending; /* output change waiting to settle */
+static struct timespec geom_deadline;
 static unsigned int numlockmask = 0;
+static Atom atoms[AtomLast];
+static const char * atom_names[AtomLast] = {
+	[NetSupported] = "_NET_SUPPORTED",
+	[NetWMCheck] = "_NET_SUPPORTING_WM_CHECK",
+	[NetWMName] = "_NET_WM_NAME",
+	[NetWMState] = "_NET_WM_STATE",
+	[NetWMFullscreen] = "_NET_WM_STATE_FULLSCREEN",
+	[NetActiveWindow] = "_NET_ACTIVE_WINDOW",
+	[NetClientList] = "_NET_CLIENT_LIST",
+	[NetCurrentDesktop] = "_NET_CURRENT_DESKTOP",
+	[NetNumberOfDesktops] = "_NET_NUMBER_OF_DESKTOPS",
+	[AtomSdwmState] = "_SDWM_STATE",
+	[AtomUTF8String] = "UTF8_STRING",
+	[AtomWMWindowRole] = "WM_WINDOW_ROLE"
+};
+static Window wm_check_window; /* carries _NET_SUPPORTING_WM_CHECK */
+static Window active_window; /* last _NET_ACTIVE_WINDOW written */
+static Window input_focus = None; /* focus as far as sdwm knows, see setinputfocus() */
+static unsigned long focus_serial; /* request that last set it */
+static Window enter_window = None; /* latest crossing not acted on, see applyenter() */
+static struct monitor *enter_monitor;
+static unsigned long crossing_first, crossing_last; /* requests whose crossings are sdwm's own */
+static unsigned long last_serial; /* of the event being dispatched */
+static long current_desktop = -1; /* last _NET_CURRENT_DESKTOP written */
+static Window * client_list; /* _NET_CLIENT_LIST as on the server, None where unlisted */
+static unsigned int client_list_length, client_list_size, client_list_holes;
+static Window * stale_windows; /* clients with stale properties, see refreshproperties() */
+static const struct rule ** rule_table; /* rules by class and instance, see compilerules() */
+static unsigned int rule_table_size;
+static unsigned int manage_properties = CACHEDPROPS; /* what manage() is handed */
+/* single producer, single consumer ring: the main thread queues at
+ * fetch_tail, the fetch thread answers up to fetch_done and the main
+ * thread takes the answers back at fetch_head */
+static struct fetch fetches[FETCHQUEUE];
+static _Atomic unsigned int fetch_tail, fetch_done;
+static unsigned int fetch_head;
+static xcb_connection_t * fetch_xcb; /* the fetch thread's own, NULL if it does not run */
+static pthread_t fetch_thread;
+static int fetch_wake[2] = { -1, -1 }, fetch_notify[2] = { -1, -1 };
+static int fetch_failed; /* its connection broke, back to the main one */
+static unsigned int stale_length, stale_size;
+static struct pool client_pool = POOL(struct client);
+static struct pool cold_pool = POOL(struct clientcold);
+static struct pool monitor_pool = POOL(struct monitor);
+static struct client ** client_index; /* window -> client hash, chained by hnext */
+static unsigned int client_index_size, client_index_bits, client_index_count;
+static unsigned long events_dropped; /* superseded events never dispatched */
+static KeySym keysyms[256]; /* symbol of each keycode when keytable was built */
+static FILE * trace; /* events read, see traceevent() */
+static const struct key ** keytable; /* keys[] entries bound to a keycode, sorted by keycode */
+static unsigned int keyoffset[257]; /* keycode k is bound to keytable[keyoffset[k]..keyoffset[k + 1]] */
 
 /* configuration, allows nested code to access above variables */
 #include "config.h"
@@ -183,9 +510,129 @@ static unsigned int numlockmask = 0;
 /* Compile-time check if no. of tags fit into an unsigned bit array */
 struct dummy { char dummy[sizeof ntags > 31 ? -1 : 1]; };
 
+/* commands accepted on the control socket, see sdwm(1) */
+static const struct command commands[] = {
+	{ "focusclient",      focusclient,      ArgWindow },
+	{ "focusmon",         focusmon,         ArgInt },
+	{ "focusstack",       focusstack,       ArgInt },
+	{ "incnmaster",       incnmaster,       ArgInt },
+	{ "killclient",       killclient,       ArgNone },
+	{ "quit",             quit,             ArgNone },
+	{ "restart",          restart,          ArgNone },
+	{ "setlayout",        setlayout,        ArgLayout },
+	{ "setmfact",         setmfact,         ArgFloat },
+	{ "tag",              tag,              ArgTag },
+	{ "tagmon",           tagmon,           ArgInt },
+	{ "togglefloating",   togglefloating,   ArgNone },
+	{ "togglefullscreen", togglefullscreen, ArgNone },
+	{ "toggletag",        toggletag,        ArgTag },
+	{ "toggleview",       toggleview,       ArgTag },
+	{ "view",             view,             ArgTag },
+	{ "zoom",             zoom,             ArgNone },
+};
+
+/* focuses what the last crossing since the queue was drained points at */
+void applyenter(void)
+{
+	struct client *c;
+	struct monitor *m;
+	if (enter_window == None)
+		return;
+	c = wintoclient(enter_window);
+	m = c ? c->monitor : enter_monitor;
+	enter_window = None;
+	if (m != selected_monitor) {
+		unfocus(selected_monitor->selected_client, 0);
+		selected_monitor = m;
+	} else if (!c || c == selected_monitor->selected_client)
+		return;
+	focus(c);
+}
+
+/* takes back what the fetch thread has answered, in the order it was asked */
+void applyfetches(void)
+{
+	struct fetch *f;
+	struct client *c;
+	char buf[64];
+	unsigned int done;
+	if (!fetch_xcb)
+		return;
+	while (read(fetch_notify[0], buf, sizeof buf) > 0);
+	done = atomic_load_explicit(&fetch_done, memory_order_acquire);
+	for (; fetch_head != done; fetch_head++) {
+		f = &fetches[fetch_head % FETCHQUEUE];
+		c = wintoclient(f->window);
+		if (f->ok == -1) {
+			/* its connection broke, redo this on the main one */
+			fetch_failed = 1;
+			setproperties(NULL, f->which, f->properties);
+			if (!f->cancelled && f->manage && !c)
+				managewindow(f->window);
+			else if (!f->cancelled && !f->manage && c)
+				staleproperties(c, f->which);
+		} else if (f->cancelled || !f->ok || (f->manage ? c || f->wa.override_redirect : !c))
+			setproperties(NULL, f->which, f->properties);
+		else if (f->manage) {
+			/* configured while it was being fetched */
+			if (f->mask & CWX)
+				f->wa.x = f->x;
+			if (f->mask & CWY)
+				f->wa.y = f->y;
+			if (f->mask & CWWidth)
+				f->wa.width = f->w;
+			if (f->mask & CWHeight)
+				f->wa.height = f->h;
+			if (f->mask & CWBorderWidth)
+				f->wa.border_width = f->bw;
+			manage(f->window, &f->wa, f->trans, f->properties);
+		} else {
+			setproperties(c, f->which, f->properties);
+			if (f->which & 1 << PropNormalHints && ISVISIBLE(c))
+				arrange(c->monitor);
+		}
+	}
+}
+
+/* places c where the rule for it says, before anything is sent for it */
+void applyrules(struct client *c, xcb_get_property_reply_t **properties)
+{
+	const struct rule *r = NULL;
+	char title[256] = "", role[64] = "";
+	int i;
+	if (!rule_table)
+		return;
+	if (manage_properties & 1 << PropNetName) {
+		propertytext(properties[PropNetName], title, sizeof title);
+		if (!*title)
+			propertytext(properties[PropName], title, sizeof title);
+	}
+	if (manage_properties & 1 << PropRole)
+		propertytext(properties[PropRole], role, sizeof role);
+	/* the most specific key first: class and instance, class, instance, none */
+	for (i = 0; i < 4 && !r; i++)
+		r = findrule(i & 2 ? NULL : c->cold->class, i & 1 ? NULL : c->cold->instance, title, role);
+	if (!r)
+		return;
+	c->isfloating = r->isfloating;
+	if (r->monitor >= 0 && r->monitor < nmonitors) {
+		c->monitor = monitor_array[r->monitor];
+		c->tags = c->monitor->tagset[c->monitor->selected_tags];
+	}
+	if (r->tags & TAGMASK)
+		c->tags = r->tags & TAGMASK;
+	if (r->w > 0 && r->h > 0) {
+		c->x = c->monitor->wx + r->x;
+		c->y = c->monitor->wy + r->y;
+		c->w = r->w;
+		c->h = r->h;
+	}
+}
+
 int applysizehints(struct client * c, int * x, int * y, int * w, int * h, int interact)
 {
 	struct monitor *m = c->monitor;
+	int baseismin;
 	/* set minimum possible */
 	*w = MAX(1, *w);
 	*h = MAX(1, *h);
@@ -208,11 +655,44 @@ int applysizehints(struct client * c, int * x, int * y, int * w, int * h, int in
 		if (*y + *h + 2 * c->bw <= m->wy)
 			*y = m->wy;
 	}
+	/* cached by setproperties(), no round trip here */
+	if (resizehints || c->isfloating || !*m->layouts[m->selected_layout]) {
+		/* see last two sentences in ICCCM 4.1.2.3 */
+		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		if (!baseismin) { /* temporarily remove base dimensions */
+			*w -= c->basew;
+			*h -= c->baseh;
+		}
+		/* adjust for aspect limits */
+		if (c->mina > 0 && c->maxa > 0) {
+			if (c->maxa < (float)*w / *h)
+				*w = *h * c->maxa + 0.5;
+			else if (c->mina < (float)*h / *w)
+				*h = *w * c->mina + 0.5;
+		}
+		if (baseismin) { /* increment calculation requires this */
+			*w -= c->basew;
+			*h -= c->baseh;
+		}
+		/* adjust for increment value */
+		if (c->incw)
+			*w -= *w % c->incw;
+		if (c->inch)
+			*h -= *h % c->inch;
+		/* restore base dimensions */
+		*w = MAX(*w + c->basew, c->minw);
+		*h = MAX(*h + c->baseh, c->minh);
+		if (c->maxw)
+			*w = MIN(*w, c->maxw);
+		if (c->maxh)
+			*h = MIN(*h, c->maxh);
+	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
 void attach(struct client * c)
 {
+	c->monitor->generation++;
 	c->next = c->monitor->clients;
 	c->monitor->clients = c;
 }
@@ -232,7 +712,7 @@ void buttonpress(XEvent * e)
 	click = ClickRootWindow;
 	/* focus monitor if necessary */
 	if ((m = wintomon(ev->window)) && m != selected_monitor) {
-		unfocus(selected_monitor->selected_client, 1);
+		unfocus(selected_monitor->selected_client, 0);
 		selected_monitor = m;
 		focus(NULL);
 	}
@@ -248,6 +728,13 @@ void buttonpress(XEvent * e)
 			buttons[i].function(&buttons[i].argument);
 }
 
+void cancelfetches(Window w)
+{
+	struct fetch *f;
+	while ((f = fetching(w)))
+		f->cancelled = 1;
+}
+
 void checkotherwm(void)
 {
 	default_error_handler = XSetErrorHandler(another_wm_error_handler);
@@ -261,10 +748,12 @@ void checkotherwm(void)
 void cleanup(void)
 {
 	union argument a = {.ui = ~0};
-	const void (* layout) (struct monitor *) = 0;
+	const void (* layout) (const struct layoutarea *, struct geometry *, unsigned int) = 0;
 	struct monitor *m;
 	size_t i;
+	stopfetch();
 	view(&a);
+	flusharrange();
 	selected_monitor->layouts[selected_monitor->selected_layout] = &layout;
 	for (m = monitors; m; m = m->next)
 		while (m->stack)
@@ -272,45 +761,215 @@ void cleanup(void)
 	XUngrabKey(display, AnyKey, AnyModifier, root_window);
 	while (monitors)
 		cleanupmon(monitors);
+	free(monitor_array);
+	free(monitor_grid);
+	free(grid_x);
+	free(grid_y);
+	free(layout_clients);
+	free(layout_geometry);
+	free(client_list);
+	free(stale_windows);
+	free(rule_table);
+	/* the root keeps none of the EWMH properties sdwm set */
+	XDestroyWindow(display, wm_check_window);
+	XDeleteProperty(display, root_window, atoms[NetWMCheck]);
+	XDeleteProperty(display, root_window, atoms[NetSupported]);
+	XDeleteProperty(display, root_window, atoms[NetNumberOfDesktops]);
+	XDeleteProperty(display, root_window, atoms[NetCurrentDesktop]);
+	XDeleteProperty(display, root_window, atoms[NetActiveWindow]);
+	XDeleteProperty(display, root_window, atoms[NetClientList]);
+	poolrelease(&client_pool);
+	poolrelease(&cold_pool);
+	poolrelease(&monitor_pool);
 	for (i = 0; i < CursorLast; i++)
 		XFreeCursor(display, cursors[i]);
 	free(colors);
+	free(client_index);
+	free(keytable);
+	for (i = 0; i < MAXCONTROLS; i++)
+		closecontrol(&controls[i]);
+	if (control_fd != -1) {
+		close(control_fd);
+		unlink(control_path);
+	}
 	XSync(display, False);
 	XSetInputFocus(display, PointerRoot, RevertToPointerRoot, CurrentTime);
 }
 
+void closecontrol(struct control *ctl)
+{
+	if (ctl->fd == -1)
+		return;
+	close(ctl->fd);
+	ctl->fd = -1;
+	ctl->length = 0;
+}
+
+/* hashes rules[] by class and instance, so a new window costs four
+ * lookups however many rules there are; rules with the same key stay in
+ * config order along the probe sequence */
+void compilerules(void)
+{
+	unsigned int i, j;
+	if (!LENGTH(rules))
+		return;
+	for (rule_table_size = 16; rule_table_size < 2 * LENGTH(rules); rule_table_size *= 2);
+	rule_table = ecalloc(rule_table_size, sizeof(struct rule *));
+	for (i = 0; i < LENGTH(rules); i++) {
+		for (j = rulehash(rules[i].class, rules[i].instance); rule_table[j];
+			j = (j + 1) & (rule_table_size - 1));
+		rule_table[j] = &rules[i];
+		/* manage() only fetches what some rule looks at */
+		if (rules[i].title)
+			manage_properties |= 1 << PropName | 1 << PropNetName;
+		if (rules[i].role)
+			manage_properties |= 1 << PropRole;
+	}
+}
+
 void cleanupmon(struct monitor * mon)
 {
 	struct monitor * m;
+	int i;
 	if (mon == monitors)
 		monitors = monitors->next;
 	else {
 		for (m = monitors; m && m->next != mon; m = m->next);
 		m->next = mon->next;
 	}
-	free(mon);
+	for (i = 0; i < LAYOUTCACHE; i++) {
+		free(mon->cache[i].clients);
+		free(mon->cache[i].geometry);
+	}
+	poolfree(&monitor_pool, mon);
+}
+
+void clientmessage(XEvent *e)
+{
+	XClientMessageEvent *cme = &e->xclient;
+	struct client *c;
+	if (!(c = wintoclient(cme->window)))
+		return;
+	if (cme->message_type == atoms[NetWMState]) {
+		if (cme->data.l[1] == atoms[NetWMFullscreen] || cme->data.l[2] == atoms[NetWMFullscreen])
+			setfullscreen(c, cme->data.l[0] == 1 /* _NET_WM_STATE_ADD */
+				|| (cme->data.l[0] == 2 /* _NET_WM_STATE_TOGGLE */ && !c->isfullscreen));
+	} else if (cme->message_type == atoms[NetActiveWindow]) {
+		if (c->monitor != selected_monitor) {
+			unfocus(selected_monitor->selected_client, 0);
+			selected_monitor = c->monitor;
+		}
+		if (!ISVISIBLE(c)) { /* like view() of the client's tags */
+			selected_monitor->selected_tags ^= 1;
+			selected_monitor->tagset[selected_monitor->selected_tags] = c->tags;
+		}
+		focus(c);
+		arrange(selected_monitor);
+	}
+}
+
+/* drops events made stale by a later one in the same batch by zeroing
+ * their type, returns how many were dropped */
+int coalesceevents(XEvent *queue, int n)
+{
+	int i, j, repeat, keyrepeat = 0, dropped = 0;
+	XEvent *enter = NULL, *motion = NULL, *key = NULL;
+	XConfigureRequestEvent *ev, *later;
+	for (i = n - 1; i >= 0; i--)
+		switch (queue[i].type) {
+		case ConfigureRequest:
+			ev = &queue[i].xconfigurerequest;
+			for (j = i + 1; j < n; j++)
+				if (queue[j].type == ConfigureRequest
+				&& queue[j].xconfigurerequest.window == ev->window)
+					break;
+			if (j == n)
+				break;
+			/* keep what only the stale request asked for */
+			later = &queue[j].xconfigurerequest;
+			if ((ev->value_mask & CWX) && !(later->value_mask & CWX))
+				later->x = ev->x;
+			if ((ev->value_mask & CWY) && !(later->value_mask & CWY))
+				later->y = ev->y;
+			if ((ev->value_mask & CWWidth) && !(later->value_mask & CWWidth))
+				later->width = ev->width;
+			if ((ev->value_mask & CWHeight) && !(later->value_mask & CWHeight))
+				later->height = ev->height;
+			if ((ev->value_mask & CWBorderWidth) && !(later->value_mask & CWBorderWidth))
+				later->border_width = ev->border_width;
+			if ((ev->value_mask & CWSibling) && !(later->value_mask & CWSibling))
+				later->above = ev->above;
+			if ((ev->value_mask & CWStackMode) && !(later->value_mask & CWStackMode))
+				later->detail = ev->detail;
+			later->value_mask |= ev->value_mask;
+			queue[i].type = 0;
+			dropped++;
+			break;
+		case EnterNotify:
+			/* only the last crossing of the batch is kept, whatever window
+			 * it is on: focus follows where the pointer ended up */
+			if (enter || (queue[i].xcrossing.serial >= crossing_first
+			&& queue[i].xcrossing.serial <= crossing_last)) {
+				queue[i].type = 0;
+				dropped++;
+			} else
+				enter = &queue[i];
+			break;
+		case MotionNotify:
+			if (queue[i].xmotion.window != root_window)
+				break;
+			if (motion) {
+				queue[i].type = 0;
+				dropped++;
+			} else
+				motion = &queue[i];
+			break;
+		case KeyPress:
+			/* auto-repeat comes as a release and a press at the same
+			 * time; a repeat is dropped only if a repeat of the same key
+			 * follows it, presses made on purpose all count */
+			repeat = i > 0 && queue[i - 1].type == KeyRelease
+				&& queue[i - 1].xkey.keycode == queue[i].xkey.keycode
+				&& queue[i - 1].xkey.time == queue[i].xkey.time;
+			if (repeat && keyrepeat && key->xkey.keycode == queue[i].xkey.keycode
+			&& CLEANMASK(key->xkey.state) == CLEANMASK(queue[i].xkey.state)) {
+				queue[i].type = 0;
+				dropped++;
+			} else {
+				key = &queue[i];
+				keyrepeat = repeat;
+			}
+			break;
+		}
+	return dropped;
+}
+
+/* replaces ev with the newest motion queued before the button release,
+ * returns how many motion events were skipped */
+unsigned int compressmotion(XEvent *ev)
+{
+	unsigned int n = 0;
+	int stop;
+	XEvent next;
+	for (stop = 0; XCheckIfEvent(display, &next, ismotion, (XPointer)&stop); stop = 0, n++) {
+		if (trace)
+			traceevent(&next, TraceCheck);
+		*ev = next;
+	}
+	return n;
 }
 
 void configurenotify(XEvent * e)
 {
-	struct monitor * m;
-	struct client * c;
 	XConfigureEvent * ev = &e->xconfigure;
-	int dirty;
-	/* TODO: updategeom handling sucks, needs to be simplified */
 	if (ev->window == root_window) {
-		dirty = (screen_width != ev->width || screen_height != ev->height);
 		screen_width = ev->width;
 		screen_height = ev->height;
-		if (updategeom() || dirty) {
-			for (m = monitors; m; m = m->next) {
-				for (c = m->clients; c; c = c->next)
-					if (c->isfullscreen)
-						resizeclient(c, m->mx, m->my, m->mw, m->mh);
-			}
-			focus(NULL);
-			arrange(NULL);
-		}
+		/* the RandR notifications for the new outputs follow */
+		if (randr_event_base != -1)
+			schedulegeom();
+		else if (updategeom())
+			geomchanged();
 	}
 }
 
@@ -318,29 +977,24 @@ void configurerequest(XEvent * e)
 {
 	struct client * c;
 	struct monitor * m;
+	struct fetch * f;
 	XConfigureRequestEvent * ev = &e->xconfigurerequest;
 	XWindowChanges wc;
 	if ((c = wintoclient(ev->window))) {
-		if (ev->value_mask & CWBorderWidth)
+		if (ev->value_mask & CWBorderWidth) {
 			c->bw = ev->border_width;
+			c->monitor->generation++;
+		}
 		else if (c->isfloating || !selected_monitor->layouts[selected_monitor->selected_layout]) {
 			m = c->monitor;
-			if (ev->value_mask & CWX) {
-				c->oldx = c->x;
+			if (ev->value_mask & CWX)
 				c->x = m->mx + ev->x;
-			}
-			if (ev->value_mask & CWY) {
-				c->oldy = c->y;
+			if (ev->value_mask & CWY)
 				c->y = m->my + ev->y;
-			}
-			if (ev->value_mask & CWWidth) {
-				c->oldw = c->w;
+			if (ev->value_mask & CWWidth)
 				c->w = ev->width;
-			}
-			if (ev->value_mask & CWHeight) {
-				c->oldh = c->h;
+			if (ev->value_mask & CWHeight)
 				c->h = ev->height;
-			}
 			if ((c->x + c->w) > m->mx + m->mw && c->isfloating)
 				c->x = m->mx + (m->mw / 2 - WIDTH(c) / 2); /* center in x direction */
 			if ((c->y + c->h) > m->my + m->mh && c->isfloating)
@@ -357,15 +1011,37 @@ void configurerequest(XEvent * e)
 		wc.sibling = ev->above;
 		wc.stack_mode = ev->detail;
 		XConfigureWindow(display, ev->window, ev->value_mask, &wc);
+		/* the fetch thread may have read the geometry before this */
+		if ((f = fetching(ev->window))) {
+			f->mask |= ev->value_mask;
+			if (ev->value_mask & CWX)
+				f->x = ev->x;
+			if (ev->value_mask & CWY)
+				f->y = ev->y;
+			if (ev->value_mask & CWWidth)
+				f->w = ev->width;
+			if (ev->value_mask & CWHeight)
+				f->h = ev->height;
+			if (ev->value_mask & CWBorderWidth)
+				f->bw = ev->border_width;
+		}
 	}
-	XSync(display, False);
+}
+
+struct client * createclient(void)
+{
+	struct client *c = poolalloc(&client_pool);
+	c->cold = poolalloc(&cold_pool);
+	c->cold->border = -1;
+	return c;
 }
 
 struct monitor * createmon(void)
 {
 	struct monitor * m;
-	m = ecalloc(1, sizeof(struct monitor));
+	m = poolalloc(&monitor_pool);
 	m->tagset[0] = m->tagset[1] = 1;
+	m->refresh = 60;
 	m->mfact = mfact;
 	m->nmasters = nmasters;
 	m->layouts[0] = &layouts[0];
@@ -379,11 +1055,14 @@ void destroynotify(XEvent *e)
 	XDestroyWindowEvent *ev = &e->xdestroywindow;
 	if ((c = wintoclient(ev->window)))
 		unmanage(c, 1);
+	else
+		cancelfetches(ev->window);
 }
 
 void detach(struct client *c)
 {
 	struct client **tc;
+	c->monitor->generation++;
 	for (tc = &c->monitor->clients; *tc && *tc != c; tc = &(*tc)->next);
 	*tc = c->next;
 }
@@ -401,15 +1080,106 @@ void detachstack(struct client *c)
 
 struct monitor * dirtomon(int dir)
 {
-	struct monitor *m = NULL;
-	if (dir > 0) {
-		if (!(m = selected_monitor->next))
-			m = monitors;
-	} else if (selected_monitor == monitors)
-		for (m = monitors; m->next; m = m->next);
-	else
-		for (m = monitors; m->next != selected_monitor; m = m->next);
-	return m;
+	return monitor_array[(selected_monitor->num + (dir > 0 ? 1 : nmonitors - 1)) % nmonitors];
+}
+
+/* runs the handler of ev and records how long it took */
+void dispatch(XEvent *ev)
+{
+	struct timespec t0, t1;
+	unsigned long us;
+	/* only RandR notifications are converted beyond the core events */
+	if (ev->type >= LASTEvent) {
+		if (randr_event_base != -1)
+			schedulegeom();
+		return;
+	}
+	if (!handler[ev->type])
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	trackpointer(ev);
+	last_serial = ev->xany.serial;
+	if (ev->type == KeyPress || ev->type == ButtonPress)
+		applyenter(); /* act on what is under the pointer by now */
+	handler[ev->type](ev); /* call handler */
+	pointer_fresh = 0;
+	event_count[ev->type]++;
+	event_latency[ev->type][latencybucket(&t0)]++;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	us = (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+	if (us >= slowest_us[ev->type]) {
+		slowest_us[ev->type] = us;
+		slowest_window[ev->type] = eventwindow(ev);
+	}
+}
+
+/* requests sent so far are the sequence number of the last one */
+void dumpstats(void)
+{
+	unsigned int i, j;
+	struct monitor *m;
+	fprintf(stderr, "sdwm: requests %lu roundtrips %lu dropped %lu\n",
+		NextRequest(display) - 1, roundtrips, events_dropped);
+	fprintf(stderr, "sdwm: clients managed %lu slabs %lu\n", clients_managed,
+		client_pool.nslabs + cold_pool.nslabs + monitor_pool.nslabs);
+	fprintf(stderr, "sdwm: layout passes %lu total %luus cached %lu\n",
+		layout_passes, layout_us, layout_cached);
+	for (m = monitors; m; m = m->next)
+		fprintf(stderr, "sdwm: monitor %d refresh %dHz arranges %lu\n",
+			m->num, m->refresh, m->arranges);
+	fprintf(stderr, "sdwm: drag motion dropped %lu latency", motion_dropped);
+	for (j = 0; j < LATENCYBUCKETS; j++)
+		if (drag_latency[j])
+			fprintf(stderr, " %s%luus:%lu", j < LATENCYBUCKETS - 1 ? "<" : ">=",
+				1UL << (j < LATENCYBUCKETS - 1 ? j : j - 1), drag_latency[j]);
+	fputc('\n', stderr);
+	for (i = 0; i < LASTEvent; i++) {
+		if (!event_count[i])
+			continue;
+		fprintf(stderr, "sdwm: %s events %lu slowest %luus window 0x%lx latency",
+			handler_name[i], event_count[i], slowest_us[i], slowest_window[i]);
+		/* bucket j holds latencies below 2^j us, the last one the rest */
+		for (j = 0; j < LATENCYBUCKETS; j++)
+			if (event_latency[i][j])
+				fprintf(stderr, " %s%luus:%lu", j < LATENCYBUCKETS - 1 ? "<" : ">=",
+					1UL << (j < LATENCYBUCKETS - 1 ? j : j - 1), event_latency[i][j]);
+		fputc('\n', stderr);
+	}
+}
+
+/* blocks for one event, then takes whatever else is already queued; a
+ * ButtonPress ends the batch since its handler may grab the pointer and
+ * read the following events itself */
+int drainevents(XEvent *queue, int size)
+{
+	int n = 0, queued;
+	if (XNextEvent(display, &queue[n++]))
+		return 0;
+	if (trace)
+		traceevent(&queue[0], TraceBatch);
+	if (queue[0].type == ButtonPress)
+		return n;
+	queued = XEventsQueued(display, QueuedAfterReading);
+	while (n < size && queued-- > 0) {
+		XNextEvent(display, &queue[n]);
+		if (trace)
+			traceevent(&queue[n], TraceQueued);
+		if (queue[n++].type == ButtonPress)
+			break;
+	}
+	return n;
+}
+
+/* the window an event is about, not the one it was reported on */
+Window eventwindow(XEvent *ev)
+{
+	switch (ev->type) {
+	case ConfigureRequest: return ev->xconfigurerequest.window;
+	case DestroyNotify: return ev->xdestroywindow.window;
+	case MapRequest: return ev->xmaprequest.window;
+	case UnmapNotify: return ev->xunmap.window;
+	default: return ev->xany.window;
+	}
 }
 
 void enternotify(XEvent *e)
@@ -419,14 +1189,106 @@ void enternotify(XEvent *e)
 	XCrossingEvent *ev = &e->xcrossing;
 	if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root_window)
 		return;
+	if (ev->serial >= crossing_first && ev->serial <= crossing_last)
+		return; /* a window moved under the pointer */
+	/* a sweep across the screen only focuses where it ends */
 	c = wintoclient(ev->window);
 	m = c ? c->monitor : wintomon(ev->window);
-	if (m != selected_monitor) {
-		unfocus(selected_monitor->selected_client, 1);
-		selected_monitor = m;
-	} else if (!c || c == selected_monitor->selected_client)
-		return;
-	focus(c);
+	enter_window = ev->window;
+	enter_monitor = m;
+}
+
+/* the protocol cannot cut a window out of a property, so the removals
+ * since the last flush are dropped in one rewrite */
+void flushclientlist(void)
+{
+	struct client *c;
+	unsigned int i, n;
+	for (i = n = 0; i < client_list_length; i++)
+		if (client_list[i] != None) {
+			if ((c = wintoclient(client_list[i])))
+				c->cold->listed = n;
+			client_list[n++] = client_list[i];
+		}
+	client_list_length = n;
+	client_list_holes = 0;
+	XChangeProperty(display, root_window, atoms[NetClientList], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *)client_list, n);
+}
+
+/* the queued fetch of w that still counts, NULL if there is none */
+struct fetch * fetching(Window w)
+{
+	unsigned int i, tail = atomic_load_explicit(&fetch_tail, memory_order_relaxed);
+	for (i = fetch_head; i != tail; i++)
+		if (fetches[i % FETCHQUEUE].window == w && !fetches[i % FETCHQUEUE].cancelled)
+			return &fetches[i % FETCHQUEUE];
+	return NULL;
+}
+
+/* runs on its own connection so the main loop never waits for replies;
+ * all queries of a wakeup are sent before the first reply is read */
+void * fetchthread(void *unused)
+{
+	static struct windowquery q[FETCHQUEUE];
+	struct fetch *f;
+	unsigned int i, done = 0, tail;
+	char buf[64];
+	while (read(fetch_wake[0], buf, sizeof buf) > 0) {
+		tail = atomic_load_explicit(&fetch_tail, memory_order_acquire);
+		for (i = done; i != tail; i++) {
+			f = &fetches[i % FETCHQUEUE];
+			if (f->manage)
+				querywindow(fetch_xcb, f->window, &q[i % FETCHQUEUE]);
+			else
+				queryproperties(fetch_xcb, f->window, f->which, q[i % FETCHQUEUE].properties);
+		}
+		xcb_flush(fetch_xcb);
+		for (i = done; i != tail; i++) {
+			f = &fetches[i % FETCHQUEUE];
+			f->ok = !f->manage || replywindow(fetch_xcb, &q[i % FETCHQUEUE], &f->wa, &f->trans);
+			replyproperties(fetch_xcb, f->which, q[i % FETCHQUEUE].properties, f->properties);
+			if (xcb_connection_has_error(fetch_xcb))
+				f->ok = -1;
+		}
+		atomic_store_explicit(&fetch_done, done = tail, memory_order_release);
+		wake(fetch_notify[1]);
+	}
+	return NULL;
+}
+
+/* queues w for the fetch thread, returns 0 if the caller has to fetch it
+ * itself */
+int fetchwindow(Window w, unsigned int which, int manage)
+{
+	unsigned int tail = atomic_load_explicit(&fetch_tail, memory_order_relaxed);
+	struct fetch *f;
+	if (!fetch_xcb || fetch_failed || tail - fetch_head == FETCHQUEUE)
+		return 0;
+	f = &fetches[tail % FETCHQUEUE];
+	f->window = w;
+	f->which = which;
+	f->manage = manage;
+	f->cancelled = 0;
+	f->mask = 0;
+	atomic_store_explicit(&fetch_tail, tail + 1, memory_order_release);
+	wake(fetch_wake[1]);
+	return 1;
+}
+
+/* the first rule keyed class and instance, NULL for none, whose title is a
+ * substring of title and whose role is role */
+const struct rule * findrule(const char *class, const char *instance, const char *title, const char *role)
+{
+	const struct rule *r;
+	unsigned int i;
+	for (i = rulehash(class, instance); (r = rule_table[i]); i = (i + 1) & (rule_table_size - 1))
+		if ((r->class == class || (r->class && class && !strcmp(r->class, class)))
+		&& (r->instance == instance || (r->instance && instance && !strcmp(r->instance, instance)))
+		&& (!r->title || strstr(title, r->title))
+		&& (!r->role || !strcmp(role, r->role)))
+			return r;
+	return NULL;
 }
 
 void focus(struct client *c)
@@ -441,19 +1303,55 @@ void focus(struct client *c)
 		detachstack(c);
 		attachstack(c);
 		grabbuttons(c, 1);
-		XSetWindowBorder(display, c->window, colors[ColorSelected].pixel);
-		XSetInputFocus(display, c->window, RevertToPointerRoot, CurrentTime);
+		c->cold->isurgent = 0;
+		setborder(c, ColorSelected);
+		/* an unmapped window cannot take the focus, flusharrange()
+		 * focuses again once it has mapped it */
+		if (c->ismapped && !c->cold->neverfocus)
+			setinputfocus(c->window);
 	} else 
-		XSetInputFocus(display, root_window, RevertToPointerRoot, CurrentTime);
+		setinputfocus(root_window);
 	selected_monitor->selected_client = c;
+	if ((c ? c->window : None) != active_window) {
+		if ((active_window = c ? c->window : None))
+			XChangeProperty(display, root_window, atoms[NetActiveWindow], XA_WINDOW, 32,
+				PropModeReplace, (unsigned char *)&active_window, 1);
+		else
+			XDeleteProperty(display, root_window, atoms[NetActiveWindow]);
+	}
+}
+
+/* focuses the client of window argument->ui, wherever it is */
+void focusclient(const union argument *argument)
+{
+	struct client *c;
+	if (!(c = wintoclient(argument->ui)) || !ISVISIBLE(c))
+		return;
+	if (c->monitor != selected_monitor) {
+		unfocus(selected_monitor->selected_client, 0);
+		selected_monitor = c->monitor;
+	}
+	focus(c);
+	restack(selected_monitor);
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
 void focusin(XEvent *e)
 {
 	XFocusChangeEvent *ev = &e->xfocus;
-	if (selected_monitor->selected_client && ev->window != selected_monitor->selected_client->window)
-		XSetInputFocus(display, selected_monitor->selected_client->window, RevertToPointerRoot, CurrentTime);
+	if (ev->serial < focus_serial)
+		return; /* from before the last XSetInputFocus, which still stands */
+	input_focus = ev->window;
+	if (selected_monitor->selected_client && !selected_monitor->selected_client->cold->neverfocus)
+		setinputfocus(selected_monitor->selected_client->window);
+}
+
+void focusout(XEvent *e)
+{
+	XFocusChangeEvent *ev = &e->xfocus;
+	if (ev->serial >= focus_serial && ev->window == input_focus
+	&& ev->mode == NotifyNormal && ev->detail != NotifyInferior)
+		input_focus = None; /* went somewhere sdwm does not see */
 }
 
 void focusmon(const union argument *argument)
@@ -491,66 +1389,202 @@ void focusstack(const union argument *argument)
 	}
 }
 
+/* refits the fullscreen clients of the monitors updategeom() changed */
+void geomchanged(void)
+{
+	struct monitor *m;
+	struct client *c;
+	for (m = monitors; m; m = m->next)
+		if (m->dirty)
+			for (c = m->clients; c; c = c->next)
+				if (c->isfullscreen)
+					resizeclient(c, m->mx, m->my, m->mw, m->mh);
+	focus(NULL);
+}
+
+/* milliseconds until a pending output change is applied, -1 if none */
+int geomwait(void)
+{
+	struct timespec now;
+	long ms;
+	if (!geom_pending)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (geom_deadline.tv_sec - now.tv_sec) * 1000
+		+ (geom_deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+	return MAX(ms, 0);
+}
+
+void freeclient(struct client *c)
+{
+	poolfree(&cold_pool, c->cold);
+	poolfree(&client_pool, c);
+}
+
 int getrootptr(int *x, int *y)
 {
-	int di;
-	unsigned int dui;
-	Window dummy;
-	return XQueryPointer(display, root_window, &dummy, &dummy, x, y, &di, &di, &dui);
+	int ok;
+	xcb_query_pointer_reply_t *reply;
+	if (pointer_fresh) {
+		*x = pointer_x;
+		*y = pointer_y;
+		return 1;
+	}
+	roundtrips++;
+	if (!(reply = xcb_query_pointer_reply(xcb, xcb_query_pointer(xcb, root_window), NULL)))
+		return 0;
+	*x = reply->root_x;
+	*y = reply->root_y;
+	ok = reply->same_screen;
+	free(reply);
+	return ok;
 }
 
+/* numlockmask is kept current by grabkeys(). A grab on AnyButton replaces
+ * the per-button grabs below it and ungrabbing it drops them too, so a
+ * mode change resends the whole set; an unchanged mode sends nothing */
 void grabbuttons(struct client *c, int focused)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	if (c->cold->buttongrab == (focused ? GrabFocused : GrabUnfocused))
+		return;
+	if (c->cold->buttongrab != GrabNone)
 		XUngrabButton(display, AnyButton, AnyModifier, c->window);
-		if (!focused)
-			XGrabButton(display, AnyButton, AnyModifier, c->window, False,
-				BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
-		for (i = 0; i < LENGTH(buttons); i++)
-			if (buttons[i].click == ClickClientWindow)
-				for (j = 0; j < LENGTH(modifiers); j++)
-					XGrabButton(display, buttons[i].button,
-						buttons[i].mask | modifiers[j],
-						c->window, False, BUTTONMASK,
-						GrabModeAsync, GrabModeSync, None, None);
-	}
+	c->cold->buttongrab = focused ? GrabFocused : GrabUnfocused;
+	if (!focused)
+		XGrabButton(display, AnyButton, AnyModifier, c->window, False,
+			BUTTONMASK, GrabModeSync, GrabModeSync, None, None);
+	for (i = 0; i < LENGTH(buttons); i++)
+		if (buttons[i].click == ClickClientWindow)
+			for (j = 0; j < LENGTH(modifiers); j++)
+				XGrabButton(display, buttons[i].button,
+					buttons[i].mask | modifiers[j],
+					c->window, False, BUTTONMASK,
+					GrabModeAsync, GrabModeSync, None, None);
+}
+
+void grabkeycode(KeyCode keycode)
+{
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+	for (i = keyoffset[keycode]; i < keyoffset[keycode + 1]; i++)
+		for (j = 0; j < LENGTH(modifiers); j++)
+			XGrabKey(display, keycode,
+				 keytable[i]->modifier | modifiers[j],
+				 root_window, True,
+				 GrabModeAsync, GrabModeAsync);
 }
 
 void grabkeys(void)
 {
+	unsigned int k, oldmask = numlockmask;
+	struct client *c;
+	struct monitor *m;
 	updatenumlockmask();
-	{
-		unsigned int i, j, k;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		int start, end, skip;
-		KeySym *syms;
-		XUngrabKey(display, AnyKey, AnyModifier, root_window);
-		XDisplayKeycodes(display, &start, &end);
-		syms = XGetKeyboardMapping(display, start, end - start + 1, &skip);
-		if (!syms)
-			return;
-		for (k = start; k <= end; k++)
-			for (i = 0; i < LENGTH(keys); i++)
-				/* skip modifier codes, we do that ourselves */
-				if (keys[i].keysym == syms[(k - start) * skip])
-					for (j = 0; j < LENGTH(modifiers); j++)
-						XGrabKey(display, k,
-							 keys[i].modifier | modifiers[j],
-							 root_window, True,
-							 GrabModeAsync, GrabModeAsync);
-		XFree(syms);
-	}
+	if (numlockmask != oldmask)
+		for (m = monitors; m; m = m->next)
+			for (c = m->clients; c; c = c->next) {
+				XUngrabButton(display, AnyButton, AnyModifier, c->window);
+				c->cold->buttongrab = GrabNone;
+				grabbuttons(c, c == selected_monitor->selected_client);
+			}
+	updatekeytable(NULL);
+	XUngrabKey(display, AnyKey, AnyModifier, root_window);
+	for (k = 0; k < LENGTH(keysyms); k++)
+		grabkeycode(k);
+}
+
+void growindex(void)
+{
+	unsigned int i, size = client_index_size;
+	struct client **old = client_index, *c, *n;
+	client_index_bits = size ? client_index_bits + 1 : 6;
+	client_index_size = 1 << client_index_bits;
+	client_index = ecalloc(client_index_size, sizeof(struct client *));
+	for (i = 0; i < size; i++)
+		for (c = old[i]; c; c = n) {
+			n = c->hnext;
+			c->hnext = client_index[WINHASH(c->window)];
+			client_index[WINHASH(c->window)] = c;
+		}
+	free(old);
+}
+
+/* the crossings the server reports for requests first up to the last one
+ * sent come from sdwm moving windows, not from the pointer */
+void ignorecrossings(unsigned long first)
+{
+	/* a range not yet passed by the event stream is only widened */
+	if (crossing_last && last_serial <= crossing_last)
+		crossing_first = MIN(crossing_first, first);
+	else
+		crossing_first = first;
+	crossing_last = NextRequest(display) - 1;
+	XNoOp(display); /* crossings after this carry a newer serial */
 }
 
 void incnmaster(const union argument *argument)
 {
 	selected_monitor->nmasters = MAX(selected_monitor->nmasters + argument->i, 0);
+	selected_monitor->generation++;
 	arrange(selected_monitor);
 }
 
+void indexclient(struct client *c)
+{
+	if (client_index_count >= client_index_size)
+		growindex();
+	c->hnext = client_index[WINHASH(c->window)];
+	client_index[WINHASH(c->window)] = c;
+	client_index_count++;
+}
+
+/* numbers the monitors and splits the screen for pointtomon() */
+void indexmonitors(void)
+{
+	struct monitor *m;
+	int i, j, n;
+	for (n = 0, m = monitors; m; m = m->next, n++);
+	free(monitor_array);
+	monitor_array = ecalloc(MAX(n, 1), sizeof(struct monitor *));
+	for (nmonitors = 0, m = monitors; m; m = m->next) {
+		m->generation++; /* geometry may have changed */
+		m->num = nmonitors;
+		monitor_array[nmonitors++] = m;
+	}
+	/* split the screen at every monitor edge, each cell lies on one monitor
+	 * or none, so pointtomon() is two binary searches */
+	free(grid_x);
+	free(grid_y);
+	free(monitor_grid);
+	grid_x = ecalloc(2 * n + 1, sizeof(int));
+	grid_y = ecalloc(2 * n + 1, sizeof(int));
+	for (i = 0, m = monitors; m; m = m->next, i += 2) {
+		grid_x[i] = m->wx;
+		grid_x[i + 1] = m->wx + m->ww;
+		grid_y[i] = m->wy;
+		grid_y[i + 1] = m->wy + m->wh;
+	}
+	grid_columns = MAX(monitoredges(grid_x, 2 * n) - 1, 0);
+	grid_rows = MAX(monitoredges(grid_y, 2 * n) - 1, 0);
+	monitor_grid = ecalloc(MAX(grid_columns * grid_rows, 1), sizeof(struct monitor *));
+	for (j = 0; j < grid_rows; j++)
+		for (i = 0; i < grid_columns; i++)
+			for (m = monitors; m && !monitor_grid[j * grid_columns + i]; m = m->next)
+				if (grid_x[i] >= m->wx && grid_x[i] < m->wx + m->ww
+				&& grid_y[j] >= m->wy && grid_y[j] < m->wy + m->wh)
+					monitor_grid[j * grid_columns + i] = m;
+}
+
+/* XCheckIfEvent() predicate: motion events up to the next button release */
+Bool ismotion(Display *display, XEvent *ev, XPointer stop)
+{
+	if (ev->type == ButtonRelease)
+		*(int *)stop = 1;
+	return !*(int *)stop && ev->type == MotionNotify;
+}
+
 #ifdef XINERAMA
 static int isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 {
@@ -565,15 +1599,26 @@ static int isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo
 void keypress(XEvent *e)
 {
 	unsigned int i;
-	KeySym keysym;
 	XKeyEvent *ev;
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(display, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].modifier) == CLEANMASK(ev->state)
-		&& keys[i].function)
-			keys[i].function(&(keys[i].argument));
+	if (ev->keycode >= LENGTH(keysyms))
+		return;
+	for (i = keyoffset[ev->keycode]; i < keyoffset[ev->keycode + 1]; i++)
+		if (CLEANMASK(keytable[i]->modifier) == CLEANMASK(ev->state)
+		&& keytable[i]->function)
+			keytable[i]->function(&(keytable[i]->argument));
+}
+
+/* microseconds since t0 as a histogram bucket: below 2^bucket us */
+unsigned int latencybucket(struct timespec *t0)
+{
+	struct timespec t1;
+	unsigned long us;
+	unsigned int bucket;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	us = (t1.tv_sec - t0->tv_sec) * 1000000 + (t1.tv_nsec - t0->tv_nsec) / 1000;
+	for (bucket = 0; bucket < LATENCYBUCKETS - 1 && us >> bucket; bucket++);
+	return bucket;
 }
 
 void killclient(const union argument *argument)
@@ -585,30 +1630,51 @@ void killclient(const union argument *argument)
 	XSetCloseDownMode(display, DestroyAll);
 	XKillClient(display, selected_monitor->selected_client->window);
 	XSync(display, False);
+	roundtrips++;
 	XSetErrorHandler(error_handler);
 	XUngrabServer(display);
 }
 
-void manage(Window w, XWindowAttributes *wa)
+/* appends c to _NET_CLIENT_LIST, see flushclientlist() for removals */
+void listclient(struct client *c)
 {
-	struct client *c, *t = NULL;
-	Window trans = None;
+	Window *old = client_list;
+	if (client_list_length == client_list_size) {
+		client_list_size = client_list_size ? client_list_size * 2 : 64;
+		client_list = ecalloc(client_list_size, sizeof(Window));
+		if (old)
+			memcpy(client_list, old, client_list_length * sizeof(Window));
+		free(old);
+	}
+	c->cold->listed = client_list_length;
+	client_list[client_list_length++] = c->window;
+	XChangeProperty(display, root_window, atoms[NetClientList], XA_WINDOW, 32,
+		PropModeAppend, (unsigned char *)&c->window, 1);
+}
+
+void manage(Window w, XWindowAttributes *wa, Window trans, xcb_get_property_reply_t **properties)
+{
+	struct client *c, *t = NULL;
 	XWindowChanges wc;
-	c = ecalloc(1, sizeof(struct client));
+	c = createclient();
 	c->window = w;
+	clients_managed++;
+	setproperties(c, CACHEDPROPS, properties);
 	/* geometry */
-	c->x = c->oldx = wa->x;
-	c->y = c->oldy = wa->y;
-	c->w = c->oldw = wa->width;
-	c->h = c->oldh = wa->height;
-	c->oldbw = wa->border_width;
-	if (XGetTransientForHint(display, w, &trans) && (t = wintoclient(trans))) {
+	c->x = c->cold->oldx = wa->x;
+	c->y = c->cold->oldy = wa->y;
+	c->w = c->cold->oldw = wa->width;
+	c->h = c->cold->oldh = wa->height;
+	c->cold->oldbw = wa->border_width;
+	if (trans != None && (t = wintoclient(trans))) {
 		c->monitor = t->monitor;
 		c->tags = t->tags;
 	} else {
 		c->monitor = selected_monitor;
 		c->tags = c->monitor->tagset[c->monitor->selected_tags];
+		applyrules(c, properties);
 	}
+	setproperties(NULL, manage_properties & ~CACHEDPROPS, properties);
 	if (c->x + WIDTH(c) > c->monitor->wx + c->monitor->ww)
 		c->x = c->monitor->wx + c->monitor->ww - WIDTH(c);
 	if (c->y + HEIGHT(c) > c->monitor->wy + c->monitor->wh)
@@ -618,52 +1684,91 @@ void manage(Window w, XWindowAttributes *wa)
 	c->bw = border_pixel;
 	wc.border_width = c->bw;
 	XConfigureWindow(display, w, CWBorderWidth, &wc);
-	XSetWindowBorder(display, w, colors[ColorNormal].pixel);
+	setborder(c, c->cold->isurgent ? ColorUrgent : ColorNormal);
 	XSelectInput(display, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
 	if (!c->isfloating)
-		c->isfloating = c->oldstate = trans != None;
+		c->isfloating = c->cold->oldstate = trans != None || c->cold->isfixed;
 	if (c->isfloating)
 		XRaiseWindow(display, c->window);
 	attach(c);
 	attachstack(c);
+	indexclient(c);
+	listclient(c);
 	/* some windows require this
 	XMoveResizeWindow(display, c->window, c->x + 2 * screen_width, c->y, c->w, c->h); */
 	if (c->monitor == selected_monitor)
 		unfocus(selected_monitor->selected_client, 0);
 	c->monitor->selected_client = c;
+	/* mapped by flusharrange() once the window has its final geometry */
 	arrange(c->monitor);
-	XMapWindow(display, c->window);
 	focus(NULL);
 }
 
 void mappingnotify(XEvent *e)
 {
+	unsigned int k;
+	unsigned char changed[LENGTH(keysyms)];
 	XMappingEvent *ev = &e->xmapping;
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
-		grabkeys();
+	if (ev->request == MappingModifier)
+		grabkeys(); /* numlock may have moved, every grab depends on it */
+	else if (ev->request == MappingKeyboard) {
+		updatekeytable(changed);
+		for (k = 0; k < LENGTH(keysyms); k++)
+			if (changed[k]) {
+				XUngrabKey(display, k, AnyModifier, root_window);
+				grabkeycode(k);
+			}
+	}
 }
 
-void maprequest(XEvent *e)
+/* manage() without the fetch thread, in one round trip */
+void managewindow(Window w)
 {
 	static XWindowAttributes wa;
+	struct windowquery q;
+	xcb_get_property_reply_t *properties[PropLast];
+	Window trans;
+	querywindow(xcb, w, &q);
+	roundtrips++;
+	if (!replywindow(xcb, &q, &wa, &trans) || wa.override_redirect) {
+		replyproperties(xcb, manage_properties, q.properties, NULL);
+		return;
+	}
+	replyproperties(xcb, manage_properties, q.properties, properties);
+	manage(w, &wa, trans, properties);
+}
+
+void maprequest(XEvent *e)
+{
 	XMapRequestEvent *ev = &e->xmaprequest;
-	if (!XGetWindowAttributes(display, ev->window, &wa) || wa.override_redirect)
+	if (wintoclient(ev->window) || fetching(ev->window))
 		return;
-	if (!wintoclient(ev->window))
-		manage(ev->window, &wa);
+	/* placed by applyfetches() once the fetch thread has read it */
+	if (!fetchwindow(ev->window, manage_properties, 1))
+		managewindow(ev->window);
 }
 
-void monocle(struct monitor *m)
+/* one frame of the monitor under x, y in milliseconds */
+unsigned int motioninterval(int x, int y)
 {
-	unsigned int n = 0;
-	struct client *c;
-	for (c = m->clients; c; c = c->next)
-		if (ISVISIBLE(c))
-			n++;
-	for (c = nexttiled(m->clients); c; c = nexttiled(c->next))
-		resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
+	return 1000 / pointtomon(x, y)->refresh;
+}
+
+/* sorts edges and drops duplicates, returns how many are left */
+int monitoredges(int *edges, int n)
+{
+	int i, j, e;
+	for (i = 1; i < n; i++) {
+		for (e = edges[i], j = i; j > 0 && edges[j - 1] > e; j--)
+			edges[j] = edges[j - 1];
+		edges[j] = e;
+	}
+	for (i = j = 0; i < n; i++)
+		if (!j || edges[i] != edges[j - 1])
+			edges[j++] = edges[i];
+	return j;
 }
 
 void motionnotify(XEvent *e)
@@ -673,10 +1778,9 @@ void motionnotify(XEvent *e)
 	XMotionEvent *ev = &e->xmotion;
 	if (ev->window != root_window)
 		return;
-	if ((m = recttomon(ev->x_root, ev->y_root, 1, 1)) != mon && mon) {
-		unfocus(selected_monitor->selected_client, 1);
-		selected_monitor = m;
-		focus(NULL);
+	if ((m = pointtomon(ev->x_root, ev->y_root)) != mon && mon) {
+		enter_window = root_window;
+		enter_monitor = m;
 	}
 	mon = m;
 }
@@ -688,6 +1792,7 @@ void movemouse(const union argument *argument)
 	struct monitor *m;
 	XEvent ev;
 	Time lasttime = 0;
+	struct timespec t0;
 	if (!(c = selected_monitor->selected_client))
 		return;
 	if (c->isfullscreen) /* no support moving fullscreen windows by mouse */
@@ -695,6 +1800,7 @@ void movemouse(const union argument *argument)
 	restack(selected_monitor);
 	ocx = c->x;
 	ocy = c->y;
+	roundtrips++;
 	if (XGrabPointer(display, root_window, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
 		None, cursors[CursorMove], CurrentTime) != GrabSuccess)
 		return;
@@ -702,6 +1808,8 @@ void movemouse(const union argument *argument)
 		return;
 	do {
 		XMaskEvent(display, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+		if (trace)
+			traceevent(&ev, TraceMask);
 		switch(ev.type) {
 		case ConfigureRequest:
 		case Expose:
@@ -709,7 +1817,9 @@ void movemouse(const union argument *argument)
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			motion_dropped += compressmotion(&ev);
+			if ((ev.xmotion.time - lasttime) < motioninterval(ev.xmotion.x_root, ev.xmotion.y_root))
 				continue;
 			lasttime = ev.xmotion.time;
 			nx = ocx + (ev.xmotion.x - x);
@@ -729,8 +1839,11 @@ void movemouse(const union argument *argument)
 			if (!selected_monitor->layouts[selected_monitor->selected_layout] ||
 				c->isfloating)
 				resize(c, nx, ny, c->w, c->h, 1);
+			XFlush(display);
+			drag_latency[latencybucket(&t0)]++;
 			break;
 		}
+		flusharrange();
 	} while (ev.type != ButtonRelease);
 	XUngrabPointer(display, CurrentTime);
 	if ((m = recttomon(c->x, c->y, c->w, c->h)) != selected_monitor) {
@@ -746,6 +1859,136 @@ struct client * nexttiled(struct client *c)
 	return c;
 }
 
+/* resolves a "name [argument]" line, returns an error message or NULL */
+const char * parsecommand(char *line, const struct command **cmd, union argument *a)
+{
+	unsigned int i;
+	char *arg, *end;
+	long n;
+	if ((arg = strchr(line, ' ')))
+		*arg++ = '\0';
+	for (i = 0; i < LENGTH(commands) && strcmp(commands[i].name, line); i++);
+	if (i == LENGTH(commands))
+		return "unknown command";
+	*cmd = &commands[i];
+	memset(a, 0, sizeof *a);
+	if (!arg || !*arg)
+		return (*cmd)->type == ArgInt || (*cmd)->type == ArgFloat
+			|| (*cmd)->type == ArgWindow ? "missing argument" : NULL;
+	switch ((*cmd)->type) {
+	case ArgNone:
+		return "unexpected argument";
+	case ArgInt:
+		a->i = strtol(arg, &end, 10);
+		break;
+	case ArgFloat:
+		a->f = strtof(arg, &end);
+		break;
+	case ArgTag: /* like the key bindings: 1..ntags, 0 for all */
+		n = strtol(arg, &end, 10);
+		if (n < 0 || n > ntags)
+			return "no such tag";
+		a->ui = n ? 1 << (n - 1) : ~0;
+		break;
+	case ArgLayout:
+		n = strtol(arg, &end, 10);
+		if (n < 0 || n >= LENGTH(layouts))
+			return "no such layout";
+		a->v = &layouts[n];
+		break;
+	default: /* ArgWindow */
+		a->ui = strtoul(arg, &end, 0);
+		break;
+	}
+	return *end ? "invalid argument" : NULL;
+}
+
+/* same answer as recttomon(x, y, 1, 1) from the grid indexmonitors() built */
+struct monitor * pointtomon(int x, int y)
+{
+	int i, j, l, r;
+	for (l = 0, r = grid_columns; l < r; ) /* last edge at or left of x */
+		if (grid_x[(i = (l + r + 1) / 2)] <= x)
+			l = i;
+		else
+			r = i - 1;
+	for (i = l, l = 0, r = grid_rows; l < r; )
+		if (grid_y[(j = (l + r + 1) / 2)] <= y)
+			l = j;
+		else
+			r = j - 1;
+	j = l;
+	if (i >= grid_columns || j >= grid_rows || x < grid_x[0] || y < grid_y[0]
+	|| !monitor_grid[j * grid_columns + i])
+		return selected_monitor;
+	return monitor_grid[j * grid_columns + i];
+}
+
+/* hands out a zeroed object, reusing freed ones before carving a new slab */
+void * poolalloc(struct pool *p)
+{
+	char *o;
+	if ((o = p->freelist)) {
+		p->freelist = *(void **)o;
+		memset(o, 0, p->size);
+		return o;
+	}
+	if (p->next == p->end) {
+		o = ecalloc(1, sizeof(void *) + SLABOBJECTS * p->size);
+		*(void **)o = p->slabs;
+		p->slabs = o;
+		p->nslabs++;
+		p->next = o + sizeof(void *);
+		p->end = p->next + SLABOBJECTS * p->size;
+	}
+	o = p->next;
+	p->next += p->size;
+	return o;
+}
+
+void poolfree(struct pool *p, void *o)
+{
+	*(void **)o = p->freelist;
+	p->freelist = o;
+}
+
+void poolrelease(struct pool *p)
+{
+	void *slab;
+	while ((slab = p->slabs)) {
+		p->slabs = *(void **)slab;
+		free(slab);
+	}
+	p->freelist = NULL;
+	p->next = p->end = NULL;
+	p->nslabs = 0;
+}
+
+void propertynotify(XEvent *e)
+{
+	XPropertyEvent *ev = &e->xproperty;
+	struct client *c;
+	if (ev->window == root_window || !(c = wintoclient(ev->window)))
+		return;
+	if (ev->atom == XA_WM_NORMAL_HINTS)
+		staleproperties(c, 1 << PropNormalHints);
+	else if (ev->atom == XA_WM_HINTS)
+		staleproperties(c, 1 << PropHints);
+	else if (ev->atom == XA_WM_CLASS)
+		staleproperties(c, 1 << PropClass);
+}
+
+/* the first string of a text property, "" if it has none */
+void propertytext(xcb_get_property_reply_t *reply, char *text, size_t size)
+{
+	int n = reply && reply->format == 8 ? xcb_get_property_value_length(reply) : 0;
+	char *value = n ? xcb_get_property_value(reply) : NULL;
+	int i;
+	for (i = 0; i < n && value[i] && i < size - 1; i++)
+		text[i] = value[i];
+	text[i] = '\0';
+}
+
 void pop(struct client *c)
 {
 	detach(c);
@@ -754,8 +1997,87 @@ void pop(struct client *c)
 	arrange(c->monitor);
 }
 
+/* sends the requests without waiting, collect them with replywindow() */
+void queryproperties(xcb_connection_t *x, Window w, unsigned int which, xcb_get_property_cookie_t *cookies)
+{
+	if (which & 1 << PropNormalHints)
+		cookies[PropNormalHints] = xcb_get_property(x, 0, w, XCB_ATOM_WM_NORMAL_HINTS,
+			XCB_ATOM_WM_SIZE_HINTS, 0, 18);
+	if (which & 1 << PropHints)
+		cookies[PropHints] = xcb_get_property(x, 0, w, XCB_ATOM_WM_HINTS,
+			XCB_ATOM_WM_HINTS, 0, 9);
+	if (which & 1 << PropClass)
+		cookies[PropClass] = xcb_get_property(x, 0, w, XCB_ATOM_WM_CLASS,
+			XCB_ATOM_STRING, 0, 64);
+	if (which & 1 << PropName)
+		cookies[PropName] = xcb_get_property(x, 0, w, XCB_ATOM_WM_NAME,
+			XCB_GET_PROPERTY_TYPE_ANY, 0, 64);
+	if (which & 1 << PropNetName)
+		cookies[PropNetName] = xcb_get_property(x, 0, w, atoms[NetWMName],
+			atoms[AtomUTF8String], 0, 64);
+	if (which & 1 << PropRole)
+		cookies[PropRole] = xcb_get_property(x, 0, w, atoms[AtomWMWindowRole],
+			XCB_ATOM_STRING, 0, 16);
+}
+
+void querywindow(xcb_connection_t *x, Window w, struct windowquery *q)
+{
+	q->attributes = xcb_get_window_attributes(x, w);
+	q->geometry = xcb_get_geometry(x, w);
+	q->transient = xcb_get_property(x, 0, w, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+	queryproperties(x, w, manage_properties, q->properties);
+}
+
 void quit(const union argument *argument) { running = 0; }
 
+#ifdef RANDR
+/* Xlib cannot convert RandR events without libXrandr, sdwm only needs to
+ * know that one arrived */
+Bool randrwire(Display *display, XEvent *re, xEvent *event)
+{
+	re->xany.type = event->u.u.type & 0x7f;
+	re->xany.serial = LastKnownRequestProcessed(display);
+	re->xany.send_event = (event->u.u.type & 0x80) != 0;
+	re->xany.display = display;
+	re->xany.window = root_window;
+	return True;
+}
+#endif /* RANDR */
+
+/* fetches what changed since the last layout pass, on the fetch thread or
+ * else all in one round trip */
+void refreshproperties(void)
+{
+	xcb_get_property_cookie_t *cookies;
+	xcb_get_property_reply_t *replies[PropLast];
+	unsigned int i, n, *which;
+	struct client *c;
+	cookies = ecalloc(stale_length * PropLast, sizeof(xcb_get_property_cookie_t));
+	which = ecalloc(stale_length, sizeof(unsigned int));
+	for (i = n = 0; i < stale_length; i++)
+		if ((c = wintoclient(stale_windows[i])) && (which[i] = c->cold->stale)) {
+			c->cold->stale = 0;
+			if (fetchwindow(c->window, which[i], 0))
+				which[i] = 0;
+			else {
+				queryproperties(xcb, c->window, which[i], &cookies[i * PropLast]);
+				n++;
+			}
+		}
+	if (n)
+		roundtrips++;
+	for (i = 0; i < stale_length; i++)
+		if (which[i] && (c = wintoclient(stale_windows[i]))) {
+			replyproperties(xcb, which[i], &cookies[i * PropLast], replies);
+			setproperties(c, which[i], replies);
+			if (which[i] & 1 << PropNormalHints && ISVISIBLE(c))
+				arrange(c->monitor);
+		}
+	stale_length = 0;
+	free(which);
+	free(cookies);
+}
+
 struct monitor * recttomon(int x, int y, int w, int h)
 {
 	struct monitor *m, *r = selected_monitor;
@@ -768,6 +2090,113 @@ struct monitor * recttomon(int x, int y, int w, int h)
 	return r;
 }
 
+/* runs every complete line, a "begin" ... "end" block as one transaction
+ * once its end has arrived; what is left stays buffered */
+void readcontrol(struct control *ctl)
+{
+	ssize_t n;
+	char *line, *nl, *end;
+	n = read(ctl->fd, ctl->buffer + ctl->length, sizeof ctl->buffer - ctl->length);
+	if (n <= 0) {
+		closecontrol(ctl);
+		return;
+	}
+	ctl->length += n;
+	for (line = ctl->buffer; (nl = memchr(line, '\n', ctl->buffer + ctl->length - line)); ) {
+		if (nl - line == 5 && !strncmp(line, "begin", 5)) {
+			/* the block ends at the first line reading "end" */
+			for (end = nl; (end = memchr(end + 1, '\n', ctl->buffer + ctl->length - end - 1)); )
+				if (end - nl >= 4 && !strncmp(end - 4, "\nend", 4))
+					break;
+			if (!end)
+				break;
+			runcommands(ctl, nl + 1, end - 3);
+			line = end + 1;
+		} else {
+			runcommands(ctl, line, nl + 1);
+			line = nl + 1;
+		}
+		if (ctl->fd == -1)
+			return;
+	}
+	ctl->length -= line - ctl->buffer;
+	memmove(ctl->buffer, line, ctl->length);
+	if (ctl->length == sizeof ctl->buffer) /* line or transaction too long */
+		closecontrol(ctl);
+}
+
+/* collects the replies to queryproperties(), or throws them away if
+ * replies is NULL */
+void replyproperties(xcb_connection_t *x, unsigned int which, xcb_get_property_cookie_t *cookies,
+	xcb_get_property_reply_t **replies)
+{
+	int i;
+	for (i = 0; i < PropLast; i++)
+		if (!(which & 1 << i))
+			continue;
+		else if (replies)
+			replies[i] = xcb_get_property_reply(x, cookies[i], NULL);
+		else
+			xcb_discard_reply(x, cookies[i].sequence);
+}
+
+/* fills the fields of wa that sdwm uses, returns 0 if the window is gone */
+int replywindow(xcb_connection_t *x, struct windowquery *q, XWindowAttributes *wa, Window *trans)
+{
+	xcb_generic_error_t *error = NULL;
+	xcb_get_window_attributes_reply_t *attributes;
+	xcb_get_geometry_reply_t *geometry;
+	xcb_get_property_reply_t *transient;
+	int ok;
+	attributes = xcb_get_window_attributes_reply(x, q->attributes, &error);
+	free(error);
+	error = NULL;
+	geometry = xcb_get_geometry_reply(x, q->geometry, &error);
+	free(error);
+	error = NULL;
+	transient = xcb_get_property_reply(x, q->transient, &error);
+	free(error);
+	*trans = None;
+	if ((ok = attributes && geometry)) {
+		wa->x = geometry->x;
+		wa->y = geometry->y;
+		wa->width = geometry->width;
+		wa->height = geometry->height;
+		wa->border_width = geometry->border_width;
+		wa->override_redirect = attributes->override_redirect;
+		wa->map_state = attributes->map_state;
+	}
+	if (transient && transient->format == 32 && xcb_get_property_value_length(transient) >= 4)
+		*trans = *(xcb_window_t *)xcb_get_property_value(transient);
+	free(attributes);
+	free(geometry);
+	free(transient);
+	return ok;
+}
+
+#if defined(RANDR) || defined(XINERAMA)
+/* hands the clients of m over to target and frees m */
+void removemon(struct monitor *m, struct monitor *target)
+{
+	struct client *c;
+	while ((c = m->clients)) {
+		m->clients = c->next;
+		detachstack(c);
+		c->monitor = target;
+		attach(c);
+		attachstack(c);
+		target->dirty = 1;
+	}
+	if (m == selected_monitor)
+		selected_monitor = target;
+	if (m == enter_monitor) { /* drop the crossing, applyenter() would use m */
+		enter_window = None;
+		enter_monitor = NULL;
+	}
+	cleanupmon(m);
+}
+#endif
+
 void resize(struct client *c, int x, int y, int w, int h, int interact)
 {
 	if (applysizehints(c, &x, &y, &w, &h, interact))
@@ -777,13 +2206,15 @@ void resize(struct client *c, int x, int y, int w, int h, int interact)
 void resizeclient(struct client *c, int x, int y, int w, int h)
 {
 	XWindowChanges wc;
-	c->oldx = c->x; c->x = wc.x = x;
-	c->oldy = c->y; c->y = wc.y = y;
-	c->oldw = c->w; c->w = wc.width = w;
-	c->oldh = c->h; c->h = wc.height = h;
+	c->x = wc.x = x;
+	c->y = wc.y = y;
+	c->w = wc.width = w;
+	c->h = wc.height = h;
+	c->ishidden = 0; /* the window is at its real position again */
 	wc.border_width = c->bw;
+	/* not synced here: configures of a layout pass stay queued until
+	 * arrange() finishes, the event loop flushes everything else */
 	XConfigureWindow(display, c->window, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-	XSync(display, False);
 }
 
 void resizemouse(const union argument *argument)
@@ -793,6 +2224,8 @@ void resizemouse(const union argument *argument)
 	struct monitor *m;
 	XEvent ev;
 	Time lasttime = 0;
+	struct timespec t0;
+	unsigned long first;
 	if (!(c = selected_monitor->selected_client))
 		return;
 	if (c->isfullscreen) /* no support resizing fullscreen windows by mouse */
@@ -800,12 +2233,15 @@ void resizemouse(const union argument *argument)
 	restack(selected_monitor);
 	ocx = c->x;
 	ocy = c->y;
+	roundtrips++;
 	if (XGrabPointer(display, root_window, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
 		None, cursors[CursorResize], CurrentTime) != GrabSuccess)
 		return;
 	XWarpPointer(display, None, c->window, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	do {
 		XMaskEvent(display, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+		if (trace)
+			traceevent(&ev, TraceMask);
 		switch(ev.type) {
 		case ConfigureRequest:
 		case Expose:
@@ -813,7 +2249,9 @@ void resizemouse(const union argument *argument)
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			motion_dropped += compressmotion(&ev);
+			if ((ev.xmotion.time - lasttime) < motioninterval(ev.xmotion.x_root, ev.xmotion.y_root))
 				continue;
 			lasttime = ev.xmotion.time;
 			nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
@@ -831,12 +2269,16 @@ void resizemouse(const union argument *argument)
 			if (!selected_monitor->layouts[selected_monitor->selected_layout] ||
 				c->isfloating)
 				resize(c, c->x, c->y, nw, nh, 1);
+			XFlush(display);
+			drag_latency[latencybucket(&t0)]++;
 			break;
 		}
+		flusharrange();
 	} while (ev.type != ButtonRelease);
+	first = NextRequest(display);
 	XWarpPointer(display, None, c->window, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(display, CurrentTime);
-	while (XCheckMaskEvent(display, EnterWindowMask, &ev));
+	ignorecrossings(first);
 	if ((m = recttomon(c->x, c->y, c->w, c->h)) != selected_monitor) {
 		sendmon(c, m);
 		selected_monitor = m;
@@ -844,46 +2286,320 @@ void resizemouse(const union argument *argument)
 	}
 }
 
+void restart(const union argument *argument)
+{
+	restarting = 1;
+	running = 0;
+}
+
+/* rebuilds clients and monitor settings from the snapshot savestate() left
+ * on the root window, returns 0 if there was none */
+int restorestate(void)
+{
+	Atom type;
+	int format;
+	unsigned long i, j, k, l, n, nc, size, after;
+	long *data = NULL, *d, *end;
+	struct monitor *m;
+	struct client *c, **restored;
+	xcb_get_window_attributes_cookie_t *cookies;
+	xcb_get_window_attributes_reply_t *reply;
+	roundtrips++;
+	if (XGetWindowProperty(display, root_window, atoms[AtomSdwmState], 0, 1L << 24, True, XA_CARDINAL,
+		&type, &format, &size, &after, (unsigned char **)&data) != Success || !data)
+		return 0;
+	if (type != XA_CARDINAL || format != 32 || size < 4 || data[0] != STATEVERSION) {
+		XFree(data);
+		return 0;
+	}
+	/* a snapshot whose records do not add up to its header, a truncated
+	 * one or one from another build, is dropped whole */
+	end = data + size;
+	for (d = data + 4, i = nc = 0; i < data[1] && end - d >= MONITORFIELDS; i++) {
+		if (d[9] < 0 || d[9] > (end - d - MONITORFIELDS) / (CLIENTFIELDS + 1))
+			break;
+		nc += d[9];
+		d += MONITORFIELDS + d[9] * (CLIENTFIELDS + 1);
+	}
+	if (d != end || i != data[1] || nc != data[3]) {
+		XFree(data);
+		return 0;
+	}
+	/* one round trip tells which saved windows are still there */
+	cookies = ecalloc(MAX(nc, 1), sizeof(xcb_get_window_attributes_cookie_t));
+	restored = ecalloc(MAX(nc, 1), sizeof(struct client *));
+	for (d = data + 4, i = k = 0; i < data[1]; i++, d += n) {
+		n = d[9];
+		d += MONITORFIELDS;
+		for (j = 0; j < n; j++, d += CLIENTFIELDS)
+			cookies[k++] = xcb_get_window_attributes(xcb, d[0]);
+	}
+	roundtrips++;
+	for (d = data + 4, i = k = 0; i < data[1]; i++, d += n) {
+		if ((unsigned long)d[0] < (unsigned long)nmonitors) {
+			m = monitor_array[d[0]];
+			m->mfact = d[1] / 10000.0;
+			m->nmasters = d[2];
+			m->tagset[0] = d[3];
+			m->tagset[1] = d[4];
+			m->selected_tags = d[5] & 1;
+			m->selected_layout = d[6] & 1;
+			if (d[7] >= 0 && d[7] < LENGTH(layouts))
+				m->layouts[0] = &layouts[d[7]];
+			if (d[8] >= 0 && d[8] < LENGTH(layouts))
+				m->layouts[1] = &layouts[d[8]];
+		} else
+			m = monitors; /* its monitor is gone */
+		m->generation++;
+		m->dirty = 1;
+		n = d[9];
+		d += MONITORFIELDS;
+		for (j = 0; j < n; j++, d += CLIENTFIELDS) {
+			restored[j] = NULL;
+			reply = xcb_get_window_attributes_reply(xcb, cookies[k++], NULL);
+			if (!reply || reply->override_redirect || reply->map_state != XCB_MAP_STATE_VIEWABLE
+			|| wintoclient(d[0])) {
+				free(reply);
+				continue;
+			}
+			free(reply);
+			c = restored[j] = createclient();
+			c->window = d[0];
+			c->monitor = m;
+			c->tags = d[1] & TAGMASK ? d[1] & TAGMASK : m->tagset[m->selected_tags];
+			c->isfloating = d[2];
+			c->isfullscreen = d[3];
+			c->cold->oldstate = d[4];
+			c->ishidden = d[5];
+			c->x = d[6]; c->y = d[7]; c->w = d[8]; c->h = d[9];
+			c->cold->oldx = d[10]; c->cold->oldy = d[11]; c->cold->oldw = d[12]; c->cold->oldh = d[13];
+			c->bw = d[14];
+			c->cold->oldbw = d[15];
+			c->ismapped = 1;
+			c->snext = c; /* not stacked yet */
+			setborder(c, ColorNormal);
+			XSelectInput(display, c->window, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
+			grabbuttons(c, 0);
+			indexclient(c);
+			listclient(c);
+			staleproperties(c, CACHEDPROPS); /* not saved */
+			clients_managed++;
+		}
+		/* attach() and attachstack() prepend, so go backwards */
+		for (l = j; l-- > 0; )
+			if (restored[l])
+				attach(restored[l]);
+		for (l = n; l-- > 0; )
+			if ((c = wintoclient(d[l])) && c->snext == c)
+				attachstack(c);
+		while (j--)
+			if (restored[j] && restored[j]->snext == restored[j])
+				attachstack(restored[j]); /* missing from the saved stack */
+	}
+	for (m = monitors; m; m = m->next) {
+		if (m->num == data[2])
+			selected_monitor = m;
+		for (c = m->stack; c && !ISVISIBLE(c); c = c->snext);
+		m->selected_client = c;
+	}
+	free(restored);
+	free(cookies);
+	XFree(data);
+	focus(NULL);
+	return 1;
+}
+
+/* FNV-1a over both strings, a NULL one hashes apart from "" */
+unsigned int rulehash(const char *class, const char *instance)
+{
+	const char *s[] = { class, instance };
+	unsigned int h = 2166136261u;
+	int i;
+	for (i = 0; i < 2; i++) {
+		h = (h ^ (s[i] != NULL)) * 16777619u;
+		for (; s[i] && *s[i]; s[i]++)
+			h = (h ^ (unsigned char)*s[i]) * 16777619u;
+	}
+	return h & (rule_table_size - 1);
+}
+
 void run(void)
 {
-	XEvent ev;
+	static XEvent queue[EVENTBATCH];
+	int i, n;
 	/* main event loop */
 	XSync(display, False);
-	while (running && !XNextEvent(display, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		/* lay out once the current batch of events is drained */
+		if (!XPending(display)) {
+			applyfetches();
+			applyenter();
+			if (!geomwait()) {
+				geom_pending = 0;
+				if (updategeom())
+					geomchanged();
+			}
+			flusharrange();
+			if (!XPending(display)) {
+				waitinput();
+				continue;
+			}
+		}
+		if (!(n = drainevents(queue, LENGTH(queue))))
+			break;
+		events_dropped += coalesceevents(queue, n);
+		for (i = 0; i < n && running; i++)
+			dispatch(&queue[i]);
+	}
+}
+
+/* lines holds newline terminated commands up to end; all of them are
+ * checked before any runs, restacks are deferred to the layout pass and
+ * a single reply covers the lot */
+void runcommands(struct control *ctl, char *lines, char *end)
+{
+	static const struct command *cmd[CONTROLBUFSIZE / 2];
+	static union argument a[CONTROLBUFSIZE / 2];
+	const char *error = NULL;
+	char reply[64], *line, *nl;
+	int i, n;
+	for (n = 0, line = lines; !error && line < end; line = nl + 1, n++) {
+		nl = memchr(line, '\n', end - line);
+		*nl = '\0';
+		error = parsecommand(line, &cmd[n], &a[n]);
+	}
+	if (error)
+		snprintf(reply, sizeof reply, "error %d %s\n", n, error);
+	else {
+		control_batch = 1;
+		for (i = 0; i < n && running; i++)
+			cmd[i]->function(&a[i]);
+		control_batch = 0;
+		snprintf(reply, sizeof reply, "ok %d\n", n);
+	}
+	if (send(ctl->fd, reply, strlen(reply), MSG_NOSIGNAL | MSG_DONTWAIT) == -1)
+		closecontrol(ctl);
+}
+
+/* leaves the client and monitor model on the root window for the process
+ * restart() execs: per monitor its settings, its clients in list order
+ * and their windows in stacking order */
+void savestate(void)
+{
+	unsigned long n = 4, i;
+	long *data, *d;
+	struct monitor *m;
+	struct client *c;
+	for (m = monitors; m; m = m->next) {
+		n += MONITORFIELDS;
+		for (c = m->clients; c; c = c->next)
+			n += CLIENTFIELDS + 1;
+	}
+	d = data = ecalloc(n, sizeof(long));
+	*d++ = STATEVERSION;
+	for (m = monitors, i = 0; m; m = m->next, i++);
+	*d++ = i;
+	*d++ = selected_monitor->num;
+	*d++ = 0;
+	for (m = monitors; m; m = m->next) {
+		for (c = m->clients, i = 0; c; c = c->next, i++);
+		data[3] += i;
+		*d++ = m->num;
+		*d++ = m->mfact * 10000;
+		*d++ = m->nmasters;
+		*d++ = m->tagset[0];
+		*d++ = m->tagset[1];
+		*d++ = m->selected_tags;
+		*d++ = m->selected_layout;
+		*d++ = m->layouts[0] - layouts;
+		*d++ = m->layouts[1] - layouts;
+		*d++ = i;
+		for (c = m->clients; c; c = c->next) {
+			*d++ = c->window;
+			*d++ = c->tags;
+			*d++ = c->isfloating;
+			*d++ = c->isfullscreen;
+			*d++ = c->cold->oldstate;
+			*d++ = c->ishidden;
+			*d++ = c->x; *d++ = c->y; *d++ = c->w; *d++ = c->h;
+			*d++ = c->cold->oldx; *d++ = c->cold->oldy; *d++ = c->cold->oldw; *d++ = c->cold->oldh;
+			*d++ = c->bw;
+			*d++ = c->cold->oldbw;
+		}
+		for (c = m->stack; c; c = c->snext)
+			*d++ = c->window;
+	}
+	XChangeProperty(display, root_window, atoms[AtomSdwmState],
+		XA_CARDINAL, 32, PropModeReplace, (unsigned char *)data, n);
+	XSync(display, False);
+	free(data);
+}
+
+/* output changes come in storms while docking, apply them once they settle */
+void schedulegeom(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &geom_deadline);
+	geom_deadline.tv_nsec += GEOMSETTLE * 1000000L;
+	geom_deadline.tv_sec += geom_deadline.tv_nsec / 1000000000L;
+	geom_deadline.tv_nsec %= 1000000000L;
+	geom_pending = 1;
 }
 
 void scan(void)
 {
 	unsigned int i, num;
-	Window d1, d2, *wins = NULL;
-	XWindowAttributes wa;
-	if (XQueryTree(display, root_window, &d1, &d2, &wins, &num)) {
-		for (i = 0; i < num; i++) {
-			if (!XGetWindowAttributes(display, wins[i], &wa)
-			|| wa.override_redirect || XGetTransientForHint(display, wins[i], &d1))
-				continue;
-			if (wa.map_state == IsViewable)
-				manage(wins[i], &wa);
-		}
-		for (i = 0; i < num; i++) { /* now the transients */
-			if (!XGetWindowAttributes(display, wins[i], &wa))
-				continue;
-			if (XGetTransientForHint(display, wins[i], &d1)
-			&& wa.map_state == IsViewable)
-				manage(wins[i], &wa);
-		}
+	Window d1, d2, *wins = NULL, *trans;
+	XWindowAttributes *wa;
+	struct windowquery *q;
+	xcb_get_property_reply_t *properties[PropLast];
+	if (!XQueryTree(display, root_window, &d1, &d2, &wins, &num) || !num) {
 		if (wins)
 			XFree(wins);
+		return;
 	}
+	/* every window is queried in one round trip */
+	q = ecalloc(num, sizeof(struct windowquery));
+	wa = ecalloc(num, sizeof(XWindowAttributes));
+	trans = ecalloc(num, sizeof(Window));
+	for (i = 0; i < num; i++)
+		if (wintoclient(wins[i])) /* restored by restorestate() */
+			wins[i] = None;
+		else
+			querywindow(xcb, wins[i], &q[i]);
+	roundtrips++;
+	for (i = 0; i < num; i++)
+		if (wins[i] && !replywindow(xcb, &q[i], &wa[i], &trans[i])) {
+			replyproperties(xcb, manage_properties, q[i].properties, NULL);
+			wins[i] = None;
+		}
+	for (i = 0; i < num; i++)
+		if (wins[i] && !wa[i].override_redirect && trans[i] == None
+		&& wa[i].map_state == IsViewable) {
+			replyproperties(xcb, manage_properties, q[i].properties, properties);
+			manage(wins[i], &wa[i], None, properties);
+			wins[i] = None;
+		}
+	for (i = 0; i < num; i++) /* now the transients */
+		if (wins[i] && trans[i] != None && wa[i].map_state == IsViewable) {
+			replyproperties(xcb, manage_properties, q[i].properties, properties);
+			manage(wins[i], &wa[i], trans[i], properties);
+			wins[i] = None;
+		}
+	for (i = 0; i < num; i++) /* not managed */
+		if (wins[i])
+			replyproperties(xcb, manage_properties, q[i].properties, NULL);
+	free(trans);
+	free(wa);
+	free(q);
+	XFree(wins);
 }
 
 void sendmon(struct client *c, struct monitor *m)
 {
 	if (c->monitor == m)
 		return;
-	unfocus(c, 1);
+	arrange(c->monitor);
+	unfocus(c, 0);
 	detach(c);
 	detachstack(c);
 	c->monitor = m;
@@ -891,20 +2607,40 @@ void sendmon(struct client *c, struct monitor *m)
 	attach(c);
 	attachstack(c);
 	focus(NULL);
-	arrange(NULL);
+	arrange(m);
 }
 
 void togglefullscreen(const union argument *argument)
 {
-	struct client * c;
-        if (!selected_monitor->selected_client)
-                return;
-        c = selected_monitor->selected_client;
-        c->isfullscreen = !c->isfullscreen;
-	if (c->isfullscreen)
+	if (selected_monitor->selected_client)
+		setfullscreen(selected_monitor->selected_client,
+			!selected_monitor->selected_client->isfullscreen);
+}
+
+void setborder(struct client *c, int color)
+{
+	if (c->cold->border == color)
+		return;
+	c->cold->border = color;
+	XSetWindowBorder(display, c->window, colors[color].pixel);
+}
+
+void setfullscreen(struct client *c, int fullscreen)
+{
+	if (!fullscreen == !c->isfullscreen)
+		return;
+	c->isfullscreen = fullscreen;
+	c->monitor->generation++;
+	XChangeProperty(display, c->window, atoms[NetWMState], XA_ATOM, 32, PropModeReplace,
+		(unsigned char *)&atoms[NetWMFullscreen], fullscreen ? 1 : 0);
+	if (fullscreen)
 	{
-		c->oldstate = c->isfloating;
-		c->oldbw = c->bw;
+		c->cold->oldstate = c->isfloating;
+		c->cold->oldbw = c->bw;
+		c->cold->oldx = c->x;
+		c->cold->oldy = c->y;
+		c->cold->oldw = c->w;
+		c->cold->oldh = c->h;
 		c->bw = 0;
 		c->isfloating = 1;
 		resizeclient(c, c->monitor->mx, c->monitor->my, c->monitor->mw, c->monitor->mh);
@@ -912,17 +2648,105 @@ void togglefullscreen(const union argument *argument)
 	}
 	else
 	{
-		c->isfloating = c->oldstate;
-		c->bw = c->oldbw;
-		c->x = c->oldx;
-		c->y = c->oldy;
-		c->w = c->oldw;
-		c->h = c->oldh;
-		resizeclient(c, c->x, c->y, c->w, c->h);
+		c->isfloating = c->cold->oldstate;
+		c->bw = c->cold->oldbw;
+		resizeclient(c, c->cold->oldx, c->cold->oldy, c->cold->oldw, c->cold->oldh);
 		arrange(c->monitor);
 	}
 }
 
+/* fills the property cache of c from the replies replyproperties()
+ * collected and frees them, or just frees them if c is NULL */
+void setproperties(struct client *c, unsigned int which, xcb_get_property_reply_t **replies)
+{
+	xcb_get_property_reply_t *reply;
+	struct clientcold *p;
+	uint32_t *v;
+	char *str;
+	int i, n;
+	if (!c) {
+		for (i = 0; i < PropLast; i++)
+			if (which & 1 << i)
+				free(replies[i]);
+		return;
+	}
+	p = c->cold;
+	if (which & 1 << PropNormalHints) {
+		reply = replies[PropNormalHints];
+		n = reply && reply->format == 32 ? xcb_get_property_value_length(reply) / 4 : 0;
+		v = n ? xcb_get_property_value(reply) : NULL;
+		c->basew = c->baseh = c->incw = c->inch = 0;
+		c->maxw = c->maxh = c->minw = c->minh = 0;
+		c->mina = c->maxa = 0;
+		if (n >= 17 && v[0] & PBaseSize) {
+			c->basew = v[15];
+			c->baseh = v[16];
+		} else if (n >= 7 && v[0] & PMinSize) {
+			c->basew = v[5];
+			c->baseh = v[6];
+		}
+		if (n >= 11 && v[0] & PResizeInc) {
+			c->incw = v[9];
+			c->inch = v[10];
+		}
+		if (n >= 9 && v[0] & PMaxSize) {
+			c->maxw = v[7];
+			c->maxh = v[8];
+		}
+		if (n >= 7 && v[0] & PMinSize) {
+			c->minw = v[5];
+			c->minh = v[6];
+		} else if (n >= 17 && v[0] & PBaseSize) {
+			c->minw = v[15];
+			c->minh = v[16];
+		}
+		if (n >= 15 && v[0] & PAspect && v[11] && v[14]) {
+			c->mina = (float)v[12] / v[11];
+			c->maxa = (float)v[13] / v[14];
+		}
+		p->isfixed = c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh;
+		free(reply);
+	}
+	if (which & 1 << PropHints) {
+		reply = replies[PropHints];
+		n = reply && reply->format == 32 ? xcb_get_property_value_length(reply) / 4 : 0;
+		v = n ? xcb_get_property_value(reply) : NULL;
+		p->isurgent = n >= 1 && v[0] & XUrgencyHint;
+		p->neverfocus = n >= 2 && v[0] & InputHint ? !v[1] : 0;
+		/* no border yet when manage() asks, it draws the first one */
+		if (c == selected_monitor->selected_client)
+			p->isurgent = 0;
+		else if (p->border != -1)
+			setborder(c, p->isurgent ? ColorUrgent : ColorNormal);
+		free(reply);
+	}
+	if (which & 1 << PropClass) {
+		reply = replies[PropClass];
+		n = reply && reply->format == 8 ? xcb_get_property_value_length(reply) : 0;
+		str = n ? xcb_get_property_value(reply) : NULL;
+		/* "instance\0class\0" */
+		for (i = 0; i < n && str[i] && i < sizeof(p->instance) - 1; i++)
+			p->instance[i] = str[i];
+		p->instance[i] = '\0';
+		for (i = 0; i < n && str[i]; i++);
+		str += i + 1;
+		n -= i + 1;
+		for (i = 0; i < n && str[i] && i < sizeof(p->class) - 1; i++)
+			p->class[i] = str[i];
+		p->class[i] = '\0';
+		free(reply);
+	}
+}
+
+void setinputfocus(Window w)
+{
+	if (w == input_focus)
+		return;
+	input_focus = w;
+	focus_serial = NextRequest(display);
+	XSetInputFocus(display, w, RevertToPointerRoot, CurrentTime);
+}
+
 void setlayout(const union argument * argument)
 {
 	if (!argument || !argument->v || argument->v !=
@@ -930,7 +2754,8 @@ void setlayout(const union argument * argument)
 		selected_monitor->selected_layout ^= 1;
 	if (argument && argument->v)
 		selected_monitor->layouts[selected_monitor->selected_layout] =
-			(void (**) (struct monitor *)) argument->v;
+			(void (**) (const struct layoutarea *, struct geometry *, unsigned int)) argument->v;
+	selected_monitor->generation++;
 	if (selected_monitor->selected_client)
 		arrange(selected_monitor);
 }
@@ -945,6 +2770,7 @@ void setmfact(const union argument *argument)
 	if (f < 0.05 || f > 0.95)
 		return;
 	selected_monitor->mfact = f;
+	selected_monitor->generation++;
 	arrange(selected_monitor);
 }
 
@@ -952,11 +2778,45 @@ void setup(void)
 {
 	int i;
 	XSetWindowAttributes wa;
+	struct sigaction sa;
+#ifdef RANDR
+	const xcb_query_extension_reply_t *ext;
+	xcb_randr_query_version_reply_t *version;
+#endif /* RANDR */
+	/* statistics are dumped from run() on SIGUSR1 */
+	if (pipe(signal_pipe) == -1)
+		die("pipe:");
+	for (i = 0; i < 2; i++) {
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(signal_pipe[i], F_SETFL, O_NONBLOCK);
+	}
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sa.sa_handler = sigusr1;
+	sigaction(SIGUSR1, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
 	/* init screen */
 	screen_number = DefaultScreen(display);
 	screen_width = DisplayWidth(display, screen_number);
 	screen_height = DisplayHeight(display, screen_number);
 	root_window = RootWindow(display, screen_number);
+	xcb = XGetXCBConnection(display);
+#ifdef RANDR
+	/* outputs are followed through their notifications, see updateoutputs() */
+	ext = xcb_get_extension_data(xcb, &xcb_randr_id);
+	roundtrips++;
+	if (ext && ext->present && (version = xcb_randr_query_version_reply(xcb,
+		xcb_randr_query_version(xcb, 1, 3), NULL))) {
+		if (version->major_version > 1 || version->minor_version >= 3) {
+			randr_event_base = ext->first_event;
+			XESetWireToEvent(display, randr_event_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY, randrwire);
+			XESetWireToEvent(display, randr_event_base + XCB_RANDR_NOTIFY, randrwire);
+			xcb_randr_select_input(xcb, root_window, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE
+				| XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+		}
+		free(version);
+	}
+#endif /* RANDR */
 	updategeom();
 	/* init cursors */
 	cursors[CursorNormal] = XCreateFontCursor(display, XC_left_ptr);
@@ -981,14 +2841,176 @@ void setup(void)
 		|LeaveWindowMask|StructureNotifyMask|PropertyChangeMask;
 	XChangeWindowAttributes(display, root_window, CWEventMask|CWCursor, &wa);
 	XSelectInput(display, root_window, wa.event_mask);
+	/* init EWMH, all atoms in one round trip */
+	XInternAtoms(display, (char **)atom_names, AtomLast, False, atoms);
+	roundtrips++;
+	wm_check_window = XCreateSimpleWindow(display, root_window, 0, 0, 1, 1, 0, 0, 0);
+	XChangeProperty(display, wm_check_window, atoms[NetWMCheck], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *)&wm_check_window, 1);
+	XChangeProperty(display, wm_check_window, atoms[NetWMName], atoms[AtomUTF8String], 8,
+		PropModeReplace, (unsigned char *)"sdwm", 4);
+	XChangeProperty(display, root_window, atoms[NetWMCheck], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *)&wm_check_window, 1);
+	XChangeProperty(display, root_window, atoms[NetSupported], XA_ATOM, 32,
+		PropModeReplace, (unsigned char *)atoms, NetLast);
+	XChangeProperty(display, root_window, atoms[NetNumberOfDesktops], XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *)&(long){ ntags }, 1);
+	XDeleteProperty(display, root_window, atoms[NetClientList]);
 	grabkeys();
+	setupcontrol();
+	compilerules();
+	startfetch();
 	focus(NULL);
 }
 
+/* listens on $SDWM_SOCKET, by default sdwm<display> in $XDG_RUNTIME_DIR
+ * or /tmp; running without a control socket is not an error */
+void setupcontrol(void)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	const char *dir;
+	mode_t mask;
+	int i;
+	for (i = 0; i < MAXCONTROLS; i++)
+		controls[i].fd = -1;
+	if (getenv("SDWM_SOCKET"))
+		snprintf(control_path, sizeof control_path, "%s", getenv("SDWM_SOCKET"));
+	else {
+		dir = getenv("XDG_RUNTIME_DIR") ? getenv("XDG_RUNTIME_DIR") : "/tmp";
+		snprintf(control_path, sizeof control_path, "%s/sdwm%s", dir, DisplayString(display));
+	}
+	strcpy(sa.sun_path, control_path);
+	unlink(control_path);
+	/* the socket is created owner only, a chmod() after bind() would
+	 * leave it open to anyone until then */
+	mask = umask(077);
+	if ((control_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+	|| fcntl(control_fd, F_SETFD, FD_CLOEXEC) == -1
+	|| fcntl(control_fd, F_SETFL, O_NONBLOCK) == -1
+	|| bind(control_fd, (struct sockaddr *)&sa, sizeof sa) == -1
+	|| listen(control_fd, MAXCONTROLS) == -1) {
+		fprintf(stderr, "sdwm: no control socket %s: %s\n", control_path, strerror(errno));
+		if (control_fd != -1)
+			close(control_fd);
+		control_fd = -1;
+	}
+	umask(mask);
+}
+
+void sigusr1(int unused)
+{
+	int saved = errno;
+	write(signal_pipe[1], "", 1);
+	errno = saved;
+}
+
+void staleproperties(struct client *c, unsigned int which)
+{
+	Window *old = stale_windows;
+	if (!c->cold->stale) {
+		if (stale_length == stale_size) {
+			stale_size = stale_size ? stale_size * 2 : 64;
+			stale_windows = ecalloc(stale_size, sizeof(Window));
+			if (old)
+				memcpy(stale_windows, old, stale_length * sizeof(Window));
+			free(old);
+		}
+		stale_windows[stale_length++] = c->window;
+	}
+	c->cold->stale |= which;
+}
+
+/* connects the fetch thread, sdwm fetches on its own connection if that
+ * fails */
+void startfetch(void)
+{
+	sigset_t all, old;
+	int i, error;
+	fetch_xcb = xcb_connect(DisplayString(display), NULL);
+	if (xcb_connection_has_error(fetch_xcb)) {
+		xcb_disconnect(fetch_xcb);
+		fetch_xcb = NULL;
+		return;
+	}
+	if (pipe(fetch_wake) == -1 || pipe(fetch_notify) == -1)
+		die("pipe:");
+	for (i = 0; i < 2; i++) {
+		fcntl(fetch_wake[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fetch_notify[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fetch_notify[i], F_SETFL, O_NONBLOCK);
+	}
+	fcntl(fetch_wake[1], F_SETFL, O_NONBLOCK);
+	/* signals are the main thread's */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	error = pthread_create(&fetch_thread, NULL, fetchthread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (error)
+		die("sdwm: cannot start the fetch thread: %s", strerror(error));
+}
+
+/* records from here on what bench/replay needs to run sdwm without a
+ * server, see trace.h */
+void starttrace(const char *path)
+{
+	struct traceheader h = { .magic = TRACEMAGIC, .version = TRACEVERSION };
+	struct tracerect r;
+	struct tracewindow w;
+	struct monitor *m;
+	struct client *c;
+	uint32_t atom;
+	int i, start, end;
+	if (!(trace = fopen(path, "w")))
+		die("sdwm: fopen %s:", path);
+	XDisplayKeycodes(display, &start, &end);
+	h.root = root_window;
+	h.width = screen_width;
+	h.height = screen_height;
+	h.minkeycode = start;
+	h.maxkeycode = end;
+	h.nmonitors = nmonitors;
+	h.natoms = AtomLast;
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			h.nwindows++;
+	for (i = 0; i < LENGTH(keysyms); i++)
+		h.keysyms[i] = keysyms[i];
+	fwrite(&h, sizeof h, 1, trace);
+	for (m = monitors; m; m = m->next) {
+		r = (struct tracerect){ m->mx, m->my, m->mw, m->mh };
+		fwrite(&r, sizeof r, 1, trace);
+	}
+	for (i = 0; i < AtomLast; i++) {
+		atom = atoms[i];
+		fwrite(&atom, sizeof atom, 1, trace);
+	}
+	for (m = monitors; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			w = (struct tracewindow){ c->window, { c->x, c->y, c->w, c->h } };
+			fwrite(&w, sizeof w, 1, trace);
+		}
+}
+
+/* lets the fetch thread answer what is queued and takes it back */
+void stopfetch(void)
+{
+	if (!fetch_xcb)
+		return;
+	close(fetch_wake[1]);
+	pthread_join(fetch_thread, NULL);
+	applyfetches();
+	close(fetch_wake[0]);
+	close(fetch_notify[0]);
+	close(fetch_notify[1]);
+	xcb_disconnect(fetch_xcb);
+	fetch_xcb = NULL;
+}
+
 void tag(const union argument *argument)
 {
 	if (selected_monitor->selected_client && argument->ui & TAGMASK) {
 		selected_monitor->selected_client->tags = argument->ui & TAGMASK;
+		selected_monitor->generation++;
 		focus(NULL);
 		arrange(selected_monitor);
 	}
@@ -1001,44 +3023,23 @@ void tagmon(const union argument *argument)
 	sendmon(selected_monitor->selected_client, dirtomon(argument->i));
 }
 
-void tile(struct monitor *m)
-{
-	unsigned int i, n, h, mw, my, ty;
-	struct client *c;
-	for (n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++);
-	if (n == 0)
-		return;
-	if (n > m->nmasters)
-		mw = m->nmasters ? m->ww * m->mfact : 0;
-	else
-		mw = m->ww;
-	for (i = my = ty = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), i++)
-		if (i < m->nmasters) {
-			h = (m->wh - my) / (MIN(n, m->nmasters) - i);
-			resize(c, m->wx, m->wy + my, mw - (2*c->bw), h - (2*c->bw), 0);
-			if (my + HEIGHT(c) < m->wh)
-				my += HEIGHT(c);
-		} else {
-			h = (m->wh - ty) / (n - i);
-			resize(c, m->wx + mw, m->wy + ty, m->ww - mw - (2*c->bw), h - (2*c->bw), 0);
-			if (ty + HEIGHT(c) < m->wh)
-				ty += HEIGHT(c);
-		}
-}
-
 void togglefloating(const union argument *argument)
 {
-	if (!selected_monitor->selected_client)
+	struct client * c = selected_monitor->selected_client;
+	if (!c)
 		return;
-	if (selected_monitor->selected_client->isfullscreen) /* no support for fullscreen windows */
+	if (c->isfullscreen) /* no support for fullscreen windows */
 		return;
-	selected_monitor->selected_client->isfloating = !selected_monitor->selected_client->isfloating;
-	if (selected_monitor->selected_client->isfloating)
-		resize(selected_monitor->selected_client,
-			selected_monitor->selected_client->oldx,
-			selected_monitor->selected_client->oldy,
-			selected_monitor->selected_client->oldw,
-			selected_monitor->selected_client->oldh, 0);
+	c->isfloating = !c->isfloating;
+	selected_monitor->generation++;
+	if (c->isfloating)
+		resize(c, c->cold->oldx, c->cold->oldy, c->cold->oldw, c->cold->oldh, 0);
+	else { /* where it floats again */
+		c->cold->oldx = c->x;
+		c->cold->oldy = c->y;
+		c->cold->oldw = c->w;
+		c->cold->oldh = c->h;
+	}
 	arrange(selected_monitor);
 }
 
@@ -1050,6 +3051,7 @@ void toggletag(const union argument *argument)
 	newtags = selected_monitor->selected_client->tags ^ (argument->ui & TAGMASK);
 	if (newtags) {
 		selected_monitor->selected_client->tags = newtags;
+		selected_monitor->generation++;
 		focus(NULL);
 		arrange(selected_monitor);
 	}
@@ -1066,14 +3068,160 @@ void toggleview(const union argument *argument)
 	}
 }
 
+/* appends ev as sdwm read it, modifier state without lock and numlock */
+void traceevent(XEvent *ev, int source)
+{
+	struct tracerecord r = { .source = source, .type = ev->type,
+		.mode = ev->xany.send_event, .window = ev->xany.window };
+	unsigned int locks = numlockmask | LockMask;
+	switch (ev->type) {
+	case ButtonPress:
+	case ButtonRelease:
+		r.detail = ev->xbutton.button;
+		r.other = ev->xbutton.subwindow;
+		r.state = ev->xbutton.state & ~locks;
+		r.x = ev->xbutton.x_root; r.y = ev->xbutton.y_root;
+		r.w = ev->xbutton.x; r.h = ev->xbutton.y;
+		r.data[0] = ev->xbutton.time;
+		break;
+	case MotionNotify:
+		r.other = ev->xmotion.subwindow;
+		r.state = ev->xmotion.state & ~locks;
+		r.x = ev->xmotion.x_root; r.y = ev->xmotion.y_root;
+		r.w = ev->xmotion.x; r.h = ev->xmotion.y;
+		r.data[0] = ev->xmotion.time;
+		break;
+	case KeyPress:
+	case KeyRelease:
+		r.detail = ev->xkey.keycode;
+		r.other = ev->xkey.subwindow;
+		r.state = ev->xkey.state & ~locks;
+		r.x = ev->xkey.x_root; r.y = ev->xkey.y_root;
+		r.w = ev->xkey.x; r.h = ev->xkey.y;
+		r.data[0] = ev->xkey.time;
+		break;
+	case EnterNotify:
+	case LeaveNotify:
+		r.mode = ev->xcrossing.mode;
+		r.detail = ev->xcrossing.detail;
+		r.other = ev->xcrossing.subwindow;
+		r.state = ev->xcrossing.state & ~locks;
+		r.x = ev->xcrossing.x_root; r.y = ev->xcrossing.y_root;
+		r.w = ev->xcrossing.x; r.h = ev->xcrossing.y;
+		r.data[0] = ev->xcrossing.time;
+		break;
+	case FocusIn:
+	case FocusOut:
+		r.mode = ev->xfocus.mode;
+		r.detail = ev->xfocus.detail;
+		break;
+	case ConfigureRequest:
+		r.window = ev->xconfigurerequest.window;
+		r.other = ev->xconfigurerequest.above;
+		r.detail = ev->xconfigurerequest.detail;
+		r.state = ev->xconfigurerequest.value_mask;
+		r.x = ev->xconfigurerequest.x; r.y = ev->xconfigurerequest.y;
+		r.w = ev->xconfigurerequest.width; r.h = ev->xconfigurerequest.height;
+		r.data[0] = ev->xconfigurerequest.border_width;
+		r.data[1] = ev->xconfigurerequest.parent;
+		break;
+	case ConfigureNotify:
+		r.window = ev->xconfigure.window;
+		r.other = ev->xconfigure.above;
+		r.x = ev->xconfigure.x; r.y = ev->xconfigure.y;
+		r.w = ev->xconfigure.width; r.h = ev->xconfigure.height;
+		r.data[0] = ev->xconfigure.border_width;
+		r.data[1] = ev->xconfigure.event;
+		break;
+	case MapRequest:
+		r.window = ev->xmaprequest.window;
+		r.other = ev->xmaprequest.parent;
+		break;
+	case DestroyNotify:
+		r.window = ev->xdestroywindow.window;
+		r.other = ev->xdestroywindow.event;
+		break;
+	case UnmapNotify:
+		r.window = ev->xunmap.window;
+		r.other = ev->xunmap.event;
+		r.state = ev->xunmap.from_configure;
+		break;
+	case PropertyNotify:
+		r.other = ev->xproperty.atom;
+		r.state = ev->xproperty.state;
+		r.data[0] = ev->xproperty.time;
+		break;
+	case ClientMessage:
+		r.detail = ev->xclient.format;
+		r.other = ev->xclient.message_type;
+		r.state = ev->xclient.data.l[0];
+		r.data[0] = ev->xclient.data.l[1];
+		r.data[1] = ev->xclient.data.l[2];
+		break;
+	case MappingNotify:
+		r.detail = ev->xmapping.request;
+		r.x = ev->xmapping.first_keycode;
+		r.y = ev->xmapping.count;
+		break;
+	case Expose:
+		r.state = ev->xexpose.count;
+		r.x = ev->xexpose.x; r.y = ev->xexpose.y;
+		r.w = ev->xexpose.width; r.h = ev->xexpose.height;
+		break;
+	}
+	fwrite(&r, sizeof r, 1, trace);
+}
+
+/* the pointer position events carry saves getrootptr() a round trip */
+void trackpointer(XEvent *ev)
+{
+	switch (ev->type) {
+	case ButtonPress:
+	case ButtonRelease:
+		pointer_fresh = ev->xbutton.same_screen;
+		pointer_x = ev->xbutton.x_root;
+		pointer_y = ev->xbutton.y_root;
+		break;
+	case KeyPress:
+	case KeyRelease:
+		pointer_fresh = ev->xkey.same_screen;
+		pointer_x = ev->xkey.x_root;
+		pointer_y = ev->xkey.y_root;
+		break;
+	case MotionNotify:
+		pointer_fresh = ev->xmotion.same_screen;
+		pointer_x = ev->xmotion.x_root;
+		pointer_y = ev->xmotion.y_root;
+		break;
+	case EnterNotify:
+	case LeaveNotify:
+		pointer_fresh = ev->xcrossing.same_screen;
+		pointer_x = ev->xcrossing.x_root;
+		pointer_y = ev->xcrossing.y_root;
+		break;
+	default:
+		pointer_fresh = 0;
+	}
+}
+
 void unfocus(struct client *c, int setfocus)
 {
 	if (!c)
 		return;
 	grabbuttons(c, 0);
-	XSetWindowBorder(display, c->window, colors[ColorNormal].pixel);
+	setborder(c, c->cold->isurgent ? ColorUrgent : ColorNormal);
 	if (setfocus)
-		XSetInputFocus(display, root_window, RevertToPointerRoot, CurrentTime);
+		setinputfocus(root_window);
+}
+
+void unindexclient(struct client *c)
+{
+	struct client **tc;
+	for (tc = &client_index[WINHASH(c->window)]; *tc && *tc != c; tc = &(*tc)->hnext);
+	if (*tc) {
+		*tc = c->hnext;
+		client_index_count--;
+	}
 }
 
 void unmanage(struct client *c, int destroyed)
@@ -1082,22 +3230,34 @@ void unmanage(struct client *c, int destroyed)
 	XWindowChanges wc;
 	detach(c);
 	detachstack(c);
+	unindexclient(c);
+	unlistclient(c);
+	cancelfetches(c->window);
+	if (input_focus == c->window)
+		input_focus = None; /* reverts, or the id gets reused */
 	if (!destroyed) {
-		wc.border_width = c->oldbw;
+		wc.border_width = c->cold->oldbw;
 		XGrabServer(display); /* avoid race conditions */
 		XSetErrorHandler(dummy_error_handler);
 		XSelectInput(display, c->window, NoEventMask);
 		XConfigureWindow(display, c->window, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(display, AnyButton, AnyModifier, c->window);
 		XSync(display, False);
+		roundtrips++;
 		XSetErrorHandler(error_handler);
 		XUngrabServer(display);
 	}
-	free(c);
+	freeclient(c);
 	focus(NULL);
 	arrange(m);
 }
 
+void unlistclient(struct client *c)
+{
+	client_list[c->cold->listed] = None;
+	client_list_holes++;
+}
+
 void unmapnotify(XEvent *e)
 {
 	struct client *c;
@@ -1105,21 +3265,26 @@ void unmapnotify(XEvent *e)
 	if ((c = wintoclient(ev->window))) {
 		if (!ev->send_event)
 			unmanage(c, 0);
-	}
+	} else
+		cancelfetches(ev->window); /* withdrawn before it was managed */
 }
 
 int updategeom(void)
 {
 	int dirty = 0;
+#ifdef RANDR
+	if (randr_event_base != -1)
+		dirty = updateoutputs();
+	else
+#endif /* RANDR */
 #ifdef XINERAMA
 	if (XineramaIsActive(display))
 	{
 		int i, j, n, nn;
-		struct client *c;
 		struct monitor *m;
 		XineramaScreenInfo *info = XineramaQueryScreens(display, &nn);
 		XineramaScreenInfo *unique = NULL;
-		for (n = 0, m = monitors; m; m = m->next, n++);
+		n = nmonitors;
 		/* only consider unique geometries as separate screens */
 		unique = ecalloc(nn, sizeof(XineramaScreenInfo));
 		for (i = 0, j = 0; i < nn; i++)
@@ -1140,8 +3305,7 @@ int updategeom(void)
 			|| unique[i].x_org != m->mx || unique[i].y_org != m->my
 			|| unique[i].width != m->mw || unique[i].height != m->mh)
 			{
-				dirty = 1;
-				m->num = i;
+				dirty = m->dirty = 1;
 				m->mx = m->wx = unique[i].x_org;
 				m->my = m->wy = unique[i].y_org;
 				m->mw = m->ww = unique[i].width;
@@ -1150,54 +3314,195 @@ int updategeom(void)
 		/* removed monitors if n > nn */
 		for (i = nn; i < n; i++) {
 			for (m = monitors; m && m->next; m = m->next);
-			while ((c = m->clients)) {
-				dirty = 1;
-				m->clients = c->next;
-				detachstack(c);
-				c->monitor = monitors;
-				attach(c);
-				attachstack(c);
-			}
-			if (m == selected_monitor)
-				selected_monitor = monitors;
-			cleanupmon(m);
+			removemon(m, monitors);
+			dirty = 1;
 		}
 		free(unique);
 	}
 	else
-	{
 #endif /* XINERAMA */
+	{
 		/* default monitor setup */
 		if (!monitors)
 			monitors = createmon();
 		if (monitors->mw != screen_width || monitors->mh != screen_height) {
-			dirty = 1;
+			dirty = monitors->dirty = 1;
 			monitors->mw = monitors->ww = screen_width;
 			monitors->mh = monitors->wh = screen_height;
 		}
-#ifdef XINERAMA
 	}
-#endif /* XINERAMA */
 	if (dirty)
 	{
+		indexmonitors();
 		selected_monitor = monitors;
 		selected_monitor = wintomon(root_window);
 	}
 	return dirty;
 }
 
+/* _NET_CURRENT_DESKTOP is the first tag the selected monitor shows */
+void updatedesktop(void)
+{
+	unsigned int tags = selected_monitor->tagset[selected_monitor->selected_tags];
+	long desktop;
+	for (desktop = 0; desktop < ntags && !(tags & 1 << desktop); desktop++);
+	if (desktop == current_desktop || desktop == ntags)
+		return;
+	current_desktop = desktop;
+	XChangeProperty(display, root_window, atoms[NetCurrentDesktop], XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *)&current_desktop, 1);
+}
+
+/* maps every keycode to the keys[] entries bound to its level 0 symbol;
+ * changed, if given, flags the keycodes whose symbol differs from the
+ * previous build */
+void updatekeytable(unsigned char *changed)
+{
+	unsigned int i, k, n;
+	int start, end;
+	KeySym sym;
+	const struct key **table;
+	XDisplayKeycodes(display, &start, &end);
+	memset(keyoffset, 0, sizeof keyoffset);
+	for (k = 0; k < LENGTH(keysyms); k++) {
+		sym = (k >= start && k <= end) ? XkbKeycodeToKeysym(display, k, 0, 0) : NoSymbol;
+		if (changed)
+			changed[k] = sym != keysyms[k];
+		keysyms[k] = sym;
+		/* count first, keyoffset[k + 1] becomes the end of keycode k */
+		for (i = 0; i < LENGTH(keys); i++)
+			if (sym != NoSymbol && keys[i].keysym == sym)
+				keyoffset[k + 1]++;
+	}
+	for (k = 0; k < LENGTH(keysyms); k++)
+		keyoffset[k + 1] += keyoffset[k];
+	table = ecalloc(MAX(keyoffset[LENGTH(keysyms)], 1), sizeof(struct key *));
+	for (k = 0; k < LENGTH(keysyms); k++)
+		for (i = 0, n = keyoffset[k]; i < LENGTH(keys); i++)
+			if (keysyms[k] != NoSymbol && keys[i].keysym == keysyms[k])
+				table[n++] = &keys[i];
+	free(keytable);
+	keytable = table;
+}
+
+#ifdef RANDR
+/* matches the monitors to the active CRTCs: monitors whose geometry did not
+ * change are left alone, the rest are resized, added or removed */
+int updateoutputs(void)
+{
+	int i, j, k, n = 0, ncrtcs, nmodes, dirty = 0, *taken;
+	xcb_randr_get_screen_resources_current_reply_t *res;
+	xcb_randr_get_crtc_info_cookie_t *cookies;
+	xcb_randr_get_crtc_info_reply_t *crtc;
+	xcb_randr_crtc_t *crtcs;
+	xcb_randr_mode_info_t *modes;
+	struct monitor *m, **last;
+	struct output {
+		int x, y, w, h, refresh;
+		struct monitor *m;
+	} *out;
+	roundtrips += 2;
+	if (!(res = xcb_randr_get_screen_resources_current_reply(xcb,
+		xcb_randr_get_screen_resources_current(xcb, root_window), NULL)))
+		return 0;
+	crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+	ncrtcs = xcb_randr_get_screen_resources_current_crtcs_length(res);
+	modes = xcb_randr_get_screen_resources_current_modes(res);
+	nmodes = xcb_randr_get_screen_resources_current_modes_length(res);
+	cookies = ecalloc(MAX(ncrtcs, 1), sizeof(xcb_randr_get_crtc_info_cookie_t));
+	out = ecalloc(ncrtcs + 1, sizeof(struct output));
+	for (i = 0; i < ncrtcs; i++)
+		cookies[i] = xcb_randr_get_crtc_info(xcb, crtcs[i], res->config_timestamp);
+	for (i = 0; i < ncrtcs; i++) {
+		if (!(crtc = xcb_randr_get_crtc_info_reply(xcb, cookies[i], NULL)))
+			continue;
+		if (crtc->mode && crtc->width && crtc->height) {
+			/* only consider unique geometries as separate screens */
+			for (j = 0; j < n && (out[j].x != crtc->x || out[j].y != crtc->y
+				|| out[j].w != crtc->width || out[j].h != crtc->height); j++);
+			if (j == n) {
+				out[n].x = crtc->x;
+				out[n].y = crtc->y;
+				out[n].w = crtc->width;
+				out[n++].h = crtc->height;
+			}
+			for (k = 0; k < nmodes && modes[k].id != crtc->mode; k++);
+			if (k < nmodes && modes[k].htotal && modes[k].vtotal)
+				out[j].refresh = MAX(out[j].refresh, (int)(modes[k].dot_clock
+					/ ((double)modes[k].htotal * modes[k].vtotal) + 0.5));
+		}
+		free(crtc);
+	}
+	free(cookies);
+	free(res);
+	if (!n) { /* every output is off */
+		out[0].w = screen_width;
+		out[0].h = screen_height;
+		n = 1;
+	}
+	taken = ecalloc(MAX(nmonitors, 1), sizeof(int));
+	/* unchanged outputs keep their monitor, clients and layout */
+	for (i = 0; i < n; i++)
+		for (k = 0; k < nmonitors && !out[i].m; k++) {
+			m = monitor_array[k];
+			if (!taken[k] && m->mx == out[i].x && m->my == out[i].y
+			&& m->mw == out[i].w && m->mh == out[i].h)
+				out[i].m = m, taken[k] = 1;
+		}
+	/* the others take over the remaining monitors in order, or new ones */
+	for (i = k = 0; i < n; i++) {
+		if ((m = out[i].m)) {
+			m->refresh = out[i].refresh ? out[i].refresh : 60;
+			continue;
+		}
+		for (; k < nmonitors && taken[k]; k++);
+		if (k < nmonitors) {
+			m = monitor_array[k];
+			taken[k] = 1;
+		} else {
+			for (last = &monitors; *last; last = &(*last)->next);
+			m = *last = createmon();
+		}
+		dirty = m->dirty = 1;
+		m->mx = m->wx = out[i].x;
+		m->my = m->wy = out[i].y;
+		m->mw = m->ww = out[i].w;
+		m->mh = m->wh = out[i].h;
+		m->refresh = out[i].refresh ? out[i].refresh : 60;
+		out[i].m = m;
+	}
+	/* monitors without an output hand their clients to the first one */
+	for (k = 0; k < nmonitors; k++)
+		if (!taken[k]) {
+			removemon(monitor_array[k], out[0].m);
+			dirty = 1;
+		}
+	free(taken);
+	free(out);
+	return dirty;
+}
+#endif /* RANDR */
+
 void updatenumlockmask(void)
 {
 	unsigned int i, j;
-	XModifierKeymap *modmap;
+	xcb_get_modifier_mapping_cookie_t cookie;
+	xcb_get_modifier_mapping_reply_t *modmap;
+	xcb_keycode_t *codes;
+	KeyCode numlock;
+	/* in flight while Xlib looks up the keycode */
+	cookie = xcb_get_modifier_mapping(xcb);
+	numlock = XKeysymToKeycode(display, XK_Num_Lock);
 	numlockmask = 0;
-	modmap = XGetModifierMapping(display);
+	roundtrips++;
+	if (!(modmap = xcb_get_modifier_mapping_reply(xcb, cookie, NULL)))
+		return;
+	codes = xcb_get_modifier_mapping_keycodes(modmap);
 	for (i = 0; i < 8; i++)
-		for (j = 0; j < modmap->max_keypermod; j++)
-			if (modmap->modifiermap[i * modmap->max_keypermod + j]
-				== XKeysymToKeycode(display, XK_Num_Lock))
+		for (j = 0; j < modmap->keycodes_per_modifier; j++)
+			if (codes[i * modmap->keycodes_per_modifier + j] == numlock)
 				numlockmask = (1 << i);
-	XFreeModifiermap(modmap);
+	free(modmap);
 }
 
 void view(const union argument *argument)
@@ -1214,12 +3519,10 @@ void view(const union argument *argument)
 struct client * wintoclient(Window w)
 {
 	struct client *c;
-	struct monitor *m;
-	for (m = monitors; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			if (c->window == w)
-				return c;
-	return NULL;
+	if (!client_index)
+		return NULL;
+	for (c = client_index[WINHASH(w)]; c && c->window != w; c = c->hnext);
+	return c;
 }
 
 struct monitor * wintomon(Window w)
@@ -1227,7 +3530,7 @@ struct monitor * wintomon(Window w)
 	int x, y;
 	struct client *c;
 	if (w == root_window && getrootptr(&x, &y))
-		return recttomon(x, y, 1, 1);
+		return pointtomon(x, y);
 	if ((c = wintoclient(w)))
 		return c->monitor;
 	return selected_monitor;
@@ -1261,6 +3564,53 @@ int another_wm_error_handler(Display *display, XErrorEvent * event)
 	return -1;
 }
 
+/* sleeps until X, a signal or the control socket has something */
+void waitinput(void)
+{
+	struct pollfd fds[4 + MAXCONTROLS] = {
+		{ .fd = ConnectionNumber(display), .events = POLLIN },
+		{ .fd = signal_pipe[0], .events = POLLIN },
+		{ .fd = control_fd, .events = POLLIN },
+		{ .fd = fetch_notify[0], .events = POLLIN },
+	};
+	char buf[64];
+	int i, fd;
+	for (i = 0; i < MAXCONTROLS; i++) {
+		fds[4 + i].fd = controls[i].fd;
+		fds[4 + i].events = POLLIN;
+	}
+	if (poll(fds, LENGTH(fds), geomwait()) <= 0)
+		return;
+	/* signals wait until pending X input is handled */
+	if (!(fds[0].revents & POLLIN) && fds[1].revents & POLLIN) {
+		while (read(signal_pipe[0], buf, sizeof buf) > 0);
+		dumpstats();
+	}
+	if (fds[2].revents & POLLIN && (fd = accept(control_fd, NULL, NULL)) != -1) {
+		for (i = 0; i < MAXCONTROLS && controls[i].fd != -1; i++);
+		if (i < MAXCONTROLS && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1
+		&& fcntl(fd, F_SETFL, O_NONBLOCK) != -1)
+			controls[i].fd = fd;
+		else
+			close(fd);
+	}
+	for (i = 0; i < MAXCONTROLS; i++)
+		if (controls[i].fd != -1 && fds[4 + i].revents & (POLLIN | POLLHUP | POLLERR))
+			readcontrol(&controls[i]);
+	if (fds[3].revents & POLLIN)
+		applyfetches();
+}
+
+/* writes a byte to the pipe fd, whose reader is then woken; a full pipe
+ * wakes it anyway */
+void wake(int fd)
+{
+	ssize_t n;
+	while ((n = write(fd, "", 1)) == -1 && errno == EINTR);
+	if (n == -1 && errno != EAGAIN)
+		die("sdwm: write:");
+}
+
 void zoom(const union argument * argument)
 {
 	struct client * c = selected_monitor->selected_client;
@@ -1273,18 +3623,79 @@ void zoom(const union argument * argument)
 
 void arrangemon(struct monitor * monitor)
 {
-        if (monitor->layouts[monitor->selected_layout] &&
-                * monitor->layouts[monitor->selected_layout])
-                (* monitor->layouts[monitor->selected_layout])(monitor);
+        struct layoutarea area = {
+                monitor->wx, monitor->wy, monitor->ww, monitor->wh,
+                monitor->mfact, monitor->nmasters
+        };
+        struct layoutcache * cache;
+        struct client * client;
+        unsigned int i, n, tagset = monitor->tagset[monitor->selected_tags];
+        if (!monitor->layouts[monitor->selected_layout] ||
+                ! * monitor->layouts[monitor->selected_layout])
+                return;
+        /* back to a tag set nothing changed for: its clients are still
+         * where the layout put them, unless something else moved them */
+        for (i = 0; i < LAYOUTCACHE; i++) {
+                cache = &monitor->cache[i];
+                if (cache->tagset != tagset || cache->generation != monitor->generation)
+                        continue;
+                for (n = 0; n < cache->n; n++) {
+                        client = cache->clients[n];
+                        resize(client, cache->geometry[n].x, cache->geometry[n].y,
+                                cache->geometry[n].w - 2 * client->bw,
+                                cache->geometry[n].h - 2 * client->bw, 0);
+                }
+                layout_cached++;
+                return;
+        }
+        if (layout_size < client_index_count) {
+                layout_size = client_index_count * 2;
+                free(layout_clients);
+                free(layout_geometry);
+                layout_clients = ecalloc(layout_size, sizeof(struct client *));
+                layout_geometry = ecalloc(layout_size, sizeof(struct geometry));
+        }
+        for (n = 0, client = nexttiled(monitor->clients); client; client = nexttiled(client->next))
+                layout_clients[n++] = client;
+        (* monitor->layouts[monitor->selected_layout])(&area, layout_geometry, n);
+        /* resize() only configures the clients that moved */
+        for (i = 0; i < n; i++) {
+                client = layout_clients[i];
+                resize(client, layout_geometry[i].x, layout_geometry[i].y,
+                        layout_geometry[i].w - 2 * client->bw,
+                        layout_geometry[i].h - 2 * client->bw, 0);
+        }
+        /* a stale entry for the same tag set is replaced first */
+        for (i = 0; i < LAYOUTCACHE && monitor->cache[i].tagset != tagset; i++);
+        if (i == LAYOUTCACHE)
+                i = monitor->cache_next++ % LAYOUTCACHE;
+        cache = &monitor->cache[i];
+        if (cache->size < n) {
+                cache->size = n * 2;
+                free(cache->clients);
+                free(cache->geometry);
+                cache->clients = ecalloc(cache->size, sizeof(struct client *));
+                cache->geometry = ecalloc(cache->size, sizeof(struct geometry));
+        }
+        memcpy(cache->clients, layout_clients, n * sizeof(struct client *));
+        memcpy(cache->geometry, layout_geometry, n * sizeof(struct geometry));
+        cache->n = n;
+        cache->tagset = tagset;
+        cache->generation = monitor->generation;
 }
 
 void restack(struct monitor * monitor)
 {
         struct client * client;
         XWindowChanges changes;
-        XEvent event;
+        unsigned long first;
+        if (control_batch) {
+                monitor->dirty = 1; /* flusharrange() restacks */
+                return;
+        }
         if (!monitor->selected_client)
                 return;
+        first = NextRequest(display);
         if (monitor->selected_client->isfloating ||
                 !monitor->layouts[monitor->selected_layout])
                 XRaiseWindow(display, monitor->selected_client->window);
@@ -1300,48 +3711,92 @@ void restack(struct monitor * monitor)
                                 changes.sibling = client->window;
                         }
         }
-        XSync(display, False);
-        while (XCheckMaskEvent(display, EnterWindowMask, &event));
+        ignorecrossings(first);
 }
 
+/* only marks the monitor, the layout pass itself runs in flusharrange() */
 void arrange(struct monitor * monitor)
 {
-        if (monitor) showhide(monitor->stack);
+        if (monitor) monitor->dirty = 1;
         else for (monitor = monitors; monitor; monitor = monitor->next)
+                monitor->dirty = 1;
+}
+
+/* lays out every dirty monitor once and maps the windows manage() left
+ * unmapped until they are in place; crossings this causes are ignored */
+void flusharrange(void)
+{
+        struct monitor * monitor;
+        struct client * client;
+        struct timespec t0, t1;
+        int mapped = 0, arranged = 0;
+        unsigned long first;
+        if (stale_length)
+                refreshproperties();
+        first = NextRequest(display);
+        for (monitor = monitors; monitor; monitor = monitor->next) {
+                if (!monitor->dirty)
+                        continue;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                monitor->dirty = 0;
+                monitor->arranges++;
+                arranged = 1;
                 showhide(monitor->stack);
-        if (monitor) {
                 arrangemon(monitor);
+                for (client = monitor->clients; client; client = client->next)
+                        if (!client->ismapped) {
+                                XMapWindow(display, client->window);
+                                client->ismapped = mapped = 1;
+                        }
                 restack(monitor);
-        } else for (monitor = monitors; monitor; monitor = monitor->next)
-                arrangemon(monitor);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                layout_passes++;
+                layout_us += (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+        }
+        if (arranged)
+                ignorecrossings(first);
+        if (mapped)
+                focus(NULL);
+        if (client_list_holes)
+                flushclientlist();
+        updatedesktop();
 }
 
+/* shows top-down, then hides; only windows whose visibility changed
+ * since the last pass are moved */
 void showhide(struct client * client)
 {
-        if (!client)
-                return;
-        if (ISVISIBLE(client)) {
-                XMoveWindow(display, client->window, client->x, client->y);
-                if ((!client->monitor->layouts[client->monitor->selected_layout] ||
-                        client->isfloating) &&
-                        !client->isfullscreen)
-                        resize(client, client->x, client->y, client->w, client->h, 0);
-                showhide(client->snext);
-        } else {
-                showhide(client->snext);
-                XMoveWindow(display, client->window, WIDTH(client) * -2, client->y);
-        }
+        struct client * c;
+        for (c = client; c; c = c->snext)
+                if (ISVISIBLE(c)) {
+                        if (c->ishidden) {
+                                XMoveWindow(display, c->window, c->x, c->y);
+                                c->ishidden = 0;
+                        }
+                        if ((!c->monitor->layouts[c->monitor->selected_layout] ||
+                                c->isfloating) &&
+                                !c->isfullscreen)
+                                resize(c, c->x, c->y, c->w, c->h, 0);
+                }
+        for (c = client; c; c = c->snext)
+                if (!ISVISIBLE(c) && !c->ishidden) {
+                        XMoveWindow(display, c->window, WIDTH(c) * -2, c->y);
+                        c->ishidden = 1;
+                }
 }
 
 int main(int argc, char * argv[])
 {
+	const char *tracepath = NULL;
 	if (argc == 2 && !strcmp("-v", argv[1]))
 	{
 		puts(VERSION);
 		return 0;
 	}
+	else if (argc == 3 && !strcmp("-r", argv[1]))
+		tracepath = argv[2];
 	else if (argc != 1)
-		die("usage: %s [-v]", argv[0]);
+		die("usage: %s [-v] [-r trace]", argv[0]);
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
 	if (!(display = XOpenDisplay(NULL)))
@@ -1349,11 +3804,28 @@ int main(int argc, char * argv[])
 	checkotherwm();
 	setup();
 #ifdef __OpenBSD__
-	if (pledge("stdio rpath proc exec", NULL) == -1)
+	if (pledge("stdio rpath cpath unix proc exec", NULL) == -1)
 		die("pledge");
 #endif /* __OpenBSD__ */
-	scan();
+	restorestate();
+	scan(); /* windows mapped while restarting */
+	if (tracepath)
+		starttrace(tracepath);
 	run();
+	if (trace)
+		fclose(trace);
+	if (restarting) {
+		/* windows stay where they are, the new process picks them up */
+		stopfetch();
+		flusharrange();
+		savestate();
+		XCloseDisplay(display);
+		/* the recording ends here, -r again would truncate it */
+		if (tracepath)
+			argv[1] = NULL;
+		execvp(argv[0], argv);
+		die("sdwm: execvp %s:", argv[0]);
+	}
 	cleanup();
 	XCloseDisplay(display);
 	return EXIT_SUCCESS;
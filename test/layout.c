@@ -0,0 +1,154 @@
+/* layout tests: checks the geometry the layout functions hand out, no X
+ * server needed. Prints each failure and exits non-zero if there was one.
+ * See layout.h. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../layout.h"
+#include "../util.h"
+
+#define LENGTH(X)               (sizeof X / sizeof X[0])
+#define MAXCLIENTS              64
+
+struct layout
+{
+	const char * name;
+	void (* arrange) (const struct layoutarea *a, struct geometry *g, unsigned int n);
+	unsigned int tiles; /* up to this many clients cover the area without gaps or overlaps */
+};
+
+static int check(int ok, const struct layout *l, const struct layoutarea *a, unsigned int n,
+	const char *what);
+static int inside(const struct geometry *g, const struct layoutarea *a);
+static int overlap(const struct geometry *p, const struct geometry *q);
+static void testcover(const struct layout *l, const struct layoutarea *a, unsigned int n);
+static void testempty(const struct layout *l, const struct layoutarea *a);
+static void testmasters(void);
+static void testsingle(const struct layout *l, const struct layoutarea *a);
+
+static const struct layout layouts[] = {
+	{ "tile",           tile,           MAXCLIENTS },
+	{ "monocle",        monocle,        0 },
+	{ "grid",           grid,           MAXCLIENTS },
+	{ "centeredmaster", centeredmaster, MAXCLIENTS },
+	{ "bstack",         bstack,         MAXCLIENTS },
+	/* past that the smallest area below cannot be halved any more and
+	 * the clients left share the last cell */
+	{ "spiral",         spiral,         12 },
+};
+
+/* odd sizes and an offset, so remainder pixels and the origin both count */
+static const struct layoutarea areas[] = {
+	{ 0, 0, 1920, 1080, 0.55, 1 },
+	{ 1920, 17, 1001, 997, 0.55, 1 },
+	{ -1280, 0, 1280, 1024, 0.3, 1 },
+	{ 5, 7, 97, 89, 0.5, 1 },
+};
+
+static const int nmasters[] = { 0, 1, 2, 3, 7 };
+
+static struct geometry g[MAXCLIENTS];
+static int failures;
+
+int check(int ok, const struct layout *l, const struct layoutarea *a, unsigned int n,
+	const char *what)
+{
+	if (!ok) {
+		printf("%s: area %dx%d%+d%+d nmasters %d n %u: %s\n", l->name,
+			a->w, a->h, a->x, a->y, a->nmasters, n, what);
+		failures++;
+	}
+	return ok;
+}
+
+int inside(const struct geometry *g, const struct layoutarea *a)
+{
+	return g->w > 0 && g->h > 0 && g->x >= a->x && g->y >= a->y
+		&& g->x + g->w <= a->x + a->w && g->y + g->h <= a->y + a->h;
+}
+
+int overlap(const struct geometry *p, const struct geometry *q)
+{
+	return p->x < q->x + q->w && q->x < p->x + p->w
+		&& p->y < q->y + q->h && q->y < p->y + p->h;
+}
+
+/* every client inside the area; as long as the layout tiles, their areas
+ * add up to the whole and no two overlap, so there is no gap either */
+void testcover(const struct layout *l, const struct layoutarea *a, unsigned int n)
+{
+	unsigned int i, j;
+	long sum = 0;
+	l->arrange(a, g, n);
+	for (i = 0; i < n; i++) {
+		if (!check(inside(&g[i], a), l, a, n, "client outside the area"))
+			return;
+		sum += (long)g[i].w * g[i].h;
+	}
+	if (n > l->tiles)
+		return;
+	for (i = 0; i < n; i++)
+		for (j = i + 1; j < n; j++)
+			if (!check(!overlap(&g[i], &g[j]), l, a, n, "clients overlap"))
+				return;
+	check(sum == (long)a->w * a->h, l, a, n, "clients leave a gap");
+}
+
+/* no clients, nothing written */
+void testempty(const struct layout *l, const struct layoutarea *a)
+{
+	static const struct geometry untouched = { 1, 2, 3, 4 };
+	g[0] = untouched;
+	l->arrange(a, g, 0);
+	check(!memcmp(&g[0], &untouched, sizeof untouched), l, a, 0, "wrote a geometry");
+}
+
+/* a lone client gets the whole area, whatever nmasters says */
+void testsingle(const struct layout *l, const struct layoutarea *a)
+{
+	l->arrange(a, g, 1);
+	check(g[0].x == a->x && g[0].y == a->y && g[0].w == a->w && g[0].h == a->h,
+		l, a, 1, "single client does not fill the area");
+}
+
+/* without masters, or with only masters, tile and bstack use one column or
+ * row across the whole area */
+void testmasters(void)
+{
+	struct layoutarea a = areas[1];
+	unsigned int i, n = 5;
+	for (a.nmasters = 0; a.nmasters <= 9; a.nmasters += 9) {
+		tile(&a, g, n);
+		for (i = 0; i < n; i++)
+			check(g[i].x == a.x && g[i].w == a.w, &layouts[0], &a, n,
+				"single column is not full width");
+		bstack(&a, g, n);
+		for (i = 0; i < n; i++)
+			check(g[i].y == a.y && g[i].h == a.h, &layouts[4], &a, n,
+				"single row is not full height");
+	}
+}
+
+int main(void)
+{
+	struct layoutarea a;
+	unsigned int i, j, k, n;
+	for (i = 0; i < LENGTH(layouts); i++)
+		for (j = 0; j < LENGTH(areas); j++)
+			for (k = 0; k < LENGTH(nmasters); k++) {
+				a = areas[j];
+				a.nmasters = nmasters[k];
+				testempty(&layouts[i], &a);
+				testsingle(&layouts[i], &a);
+				for (n = 1; n <= 40; n++)
+					testcover(&layouts[i], &a, n);
+			}
+	testmasters();
+	if (failures) {
+		printf("layout: %d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	puts("layout: ok");
+	return EXIT_SUCCESS;
+}
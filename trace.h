@@ -0,0 +1,46 @@
+/* event traces sdwm -r writes and bench/replay reads, in native byte order:
+ * a header, its variable parts, then one record per event until the end */
+#define TRACEMAGIC              0x74776473 /* "sdwt" */
+#define TRACEVERSION            1
+
+/* how sdwm read an event, replay hands it out to the same kind of read */
+enum { TraceBatch, TraceQueued, TraceMask, TraceCheck };
+
+struct traceheader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t root;
+	uint16_t width, height; /* of the root window */
+	uint8_t minkeycode, maxkeycode;
+	uint8_t nmonitors; /* followed by as many struct tracerect */
+	uint8_t natoms; /* then the atoms sdwm interned, as uint32_t */
+	uint32_t nwindows; /* then the clients managed when recording began */
+	uint32_t keysyms[256]; /* level 0 keysym of each keycode */
+};
+
+struct tracerect
+{
+	int16_t x, y;
+	uint16_t w, h;
+};
+
+struct tracewindow
+{
+	uint32_t window;
+	struct tracerect r;
+};
+
+/* 32 bytes whatever the event, fields unused by a type are 0 */
+struct tracerecord
+{
+	uint8_t source; /* Trace* */
+	uint8_t type;
+	uint8_t detail; /* keycode, button, crossing, focus or stacking detail */
+	uint8_t mode; /* crossing or focus mode, send_event otherwise */
+	uint32_t window;
+	uint32_t other; /* subwindow, sibling, parent, atom or message type */
+	uint32_t state; /* modifiers, value mask or first message word */
+	int16_t x, y, w, h; /* geometry, or root then window pointer position */
+	uint32_t data[2]; /* time and border width, or message words */
+};